@@ -0,0 +1,265 @@
+/**
+  Hardware independent parts of the RFID reader firmware, see RFIDCore.h
+
+  GitHub repository:
+    https://github.com/sumnerboy12/OXRS-BJ-RFIDReader-ESP-FW
+
+  Copyright 2022 Ben Jones <ben.jones12@gmail.com>
+*/
+
+#include "RFIDCore.h"
+
+/*--------------------------- Tags ------------------------------------*/
+uint8_t getCardType(uint8_t sak)
+{
+  if (sak & 0x20) { return CARD_ISO14443_4; }
+  if (sak & 0x08) { return CARD_CLASSIC; }
+  if (sak == 0x00) { return CARD_TYPE2; }
+  return CARD_UNKNOWN;
+}
+
+bool scanAdd(ScannedTag tags[], uint8_t * count, uint8_t maxTags, uint8_t uid[], uint8_t uidLength, uint8_t cardType)
+{
+  if (uidLength == 0 || uidLength > MAX_UID_BYTES)
+    return false;
+
+  // a tag that wasn't halted can answer more than once
+  for (uint8_t i = 0; i < *count; i++)
+  {
+    if (tags[i].uidLength == uidLength && memcmp(tags[i].uid, uid, uidLength) == 0)
+      return false;
+  }
+
+  if (*count >= maxTags)
+    return false;
+
+  ScannedTag * tag = &tags[(*count)++];
+  memcpy(tag->uid, uid, uidLength);
+  tag->uidLength = uidLength;
+  tag->cardType = cardType;
+  return true;
+}
+
+int8_t findNdefTlv(uint8_t data[], uint16_t len, uint16_t * start, uint16_t * length)
+{
+  // walk the TLV blocks, returns 1 if found, 0 if more data needed, -1 if none
+  uint16_t i = 0;
+  while (i < len)
+  {
+    uint8_t t = data[i];
+
+    // NULL TLV has no length, terminator ends the data area
+    if (t == 0x00) { i++; continue; }
+    if (t == 0xFE) { return -1; }
+
+    if (i + 1 >= len)
+      return 0;
+
+    // one byte length, or 0xFF followed by a two byte length
+    uint16_t l = data[i + 1];
+    uint16_t v = i + 2;
+    if (l == 0xFF)
+    {
+      if (i + 3 >= len)
+        return 0;
+
+      l = (data[i + 2] << 8) | data[i + 3];
+      v = i + 4;
+    }
+
+    if (t == 0x03)
+    {
+      *start = v;
+      *length = l;
+      return 1;
+    }
+
+    i = v + l;
+  }
+
+  return 0;
+}
+
+/*--------------------------- Serial Framing --------------------------*/
+uint16_t crc16(uint8_t data[], uint16_t len)
+{
+  // CRC-16/CCITT-FALSE
+  uint16_t crc = 0xFFFF;
+  for (uint16_t i = 0; i < len; i++)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+uint16_t cobsEncode(uint8_t output[], uint8_t input[], uint16_t len)
+{
+  // consistent overhead byte stuffing, so 0x00 only ever appears as a delimiter
+  uint16_t out = 1;
+  uint16_t code = 0;
+  uint8_t run = 1;
+
+  for (uint16_t i = 0; i < len; i++)
+  {
+    if (input[i] != 0x00)
+    {
+      output[out++] = input[i];
+      run++;
+    }
+
+    if (input[i] == 0x00 || run == 0xFF)
+    {
+      output[code] = run;
+      code = out++;
+      run = 1;
+    }
+  }
+
+  output[code] = run;
+  return out;
+}
+
+/*--------------------------- Event Pool ------------------------------*/
+int32_t eventPoolFit(EventSlot queue[], uint8_t queueSize, uint8_t head, uint8_t count, uint16_t poolBytes, uint16_t length)
+{
+  if (count == 0)
+    return length <= poolBytes ? 0 : -1;
+
+  // events are stored in order, wrapping back to the start of the pool
+  uint16_t first = queue[head].offset;
+  EventSlot * last = &queue[(head + count - 1) % queueSize];
+  uint16_t tail = last->offset + last->length;
+
+  if (last->offset >= first)
+  {
+    if (poolBytes - tail >= length) { return tail; }
+    if (first >= length) { return 0; }
+  }
+  else
+  {
+    if (first - tail >= length) { return tail; }
+  }
+
+  return -1;
+}
+
+int32_t eventPoolReserve(EventSlot queue[], uint8_t queueSize, uint8_t * head, uint8_t * count, uint16_t poolBytes, uint16_t length, uint32_t * dropped)
+{
+  // too big to ever hold, don't throw away queued events for it
+  if (length > poolBytes)
+    return -1;
+
+  // make room by dropping the oldest
+  int32_t offset = eventPoolFit(queue, queueSize, *head, *count, poolBytes, length);
+  while (*count == queueSize || offset < 0)
+  {
+    *head = (*head + 1) % queueSize;
+    (*count)--;
+    (*dropped)++;
+    offset = eventPoolFit(queue, queueSize, *head, *count, poolBytes, length);
+  }
+
+  return offset;
+}
+
+/*--------------------------- Detection -------------------------------*/
+void tuneDetectTimeout(DetectTuner * tuner, bool present, bool detected, uint32_t elapsedUs, uint8_t uid[], uint8_t uidLength)
+{
+  if (!detected)
+  {
+    // a miss while the filter still says present may be a tag we gave up
+    // on too soon, we only know once (if) it answers again - idle polls
+    // and the run-out after a removal tell us nothing
+    if (!present) { tuner->missPending = 0; }
+    else if (tuner->missPending < 0xFF) { tuner->missPending++; }
+    return;
+  }
+
+  // the same tag answering after misses means the timeout was too short,
+  // so hold it above where it was for a window of samples
+  bool sameTag = tuner->lastUidLength == uidLength && memcmp(tuner->lastUid, uid, uidLength) == 0;
+  if (tuner->missPending > 0 && sameTag)
+  {
+    tuner->censored += tuner->missPending;
+    tuner->floorMs = tuner->timeoutMs + DETECT_TIMEOUT_MARGIN_MS;
+    if (tuner->floorMs > MAX_DETECT_TIMEOUT_MS) { tuner->floorMs = MAX_DETECT_TIMEOUT_MS; }
+    tuner->floorHold = DETECT_SAMPLES;
+  }
+  else if (tuner->floorHold > 0 && --tuner->floorHold == 0)
+  {
+    tuner->floorMs = 0L;
+  }
+
+  tuner->missPending = 0;
+  memcpy(tuner->lastUid, uid, uidLength);
+  tuner->lastUidLength = uidLength;
+
+  // only real response times go in the pool, so the tuner never feeds on
+  // its own output
+  tuner->samplesUs[tuner->sampleNext] = elapsedUs;
+  tuner->sampleNext = (tuner->sampleNext + 1) % DETECT_SAMPLES;
+  if (tuner->sampleCount < DETECT_SAMPLES) { tuner->sampleCount++; }
+
+  // a fixed timeout has been configured
+  if (tuner->configMs > 0)
+  {
+    tuner->timeoutMs = tuner->configMs;
+    return;
+  }
+
+  if (tuner->sampleCount < MIN_DETECT_SAMPLES)
+  {
+    if (tuner->timeoutMs < tuner->floorMs) { tuner->timeoutMs = tuner->floorMs; }
+    return;
+  }
+
+  // insertion sort a copy of the samples to find our percentile
+  uint32_t sorted[DETECT_SAMPLES];
+  for (uint8_t i = 0; i < tuner->sampleCount; i++)
+  {
+    uint32_t sample = tuner->samplesUs[i];
+    uint8_t j = i;
+    while (j > 0 && sorted[j - 1] > sample)
+    {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = sample;
+  }
+
+  tuner->percentileUs = sorted[(tuner->sampleCount * DETECT_TIMEOUT_PERCENTILE - 1) / 100];
+
+  uint32_t timeoutMs = (tuner->percentileUs + 999) / 1000 + DETECT_TIMEOUT_MARGIN_MS;
+  if (timeoutMs < tuner->floorMs) { timeoutMs = tuner->floorMs; }
+  if (timeoutMs < MIN_DETECT_TIMEOUT_MS) { timeoutMs = MIN_DETECT_TIMEOUT_MS; }
+  if (timeoutMs > MAX_DETECT_TIMEOUT_MS) { timeoutMs = MAX_DETECT_TIMEOUT_MS; }
+  tuner->timeoutMs = timeoutMs;
+}
+
+bool filterPresence(PresenceFilter * filter, bool detected)
+{
+  uint16_t mask = filter->window >= 16 ? 0xFFFF : (1 << filter->window) - 1;
+  filter->history = ((filter->history << 1) | (detected ? 1 : 0)) & mask;
+
+  uint8_t hits = 0;
+  for (uint16_t bits = filter->history; bits; bits >>= 1)
+  {
+    hits += bits & 1;
+  }
+
+  bool filtered = hits >= filter->threshold;
+
+  // a raw edge the filter absorbed is edge-of-field flicker
+  if (detected != filter->lastRaw && filtered == filter->filtered)
+  {
+    filter->flicker++;
+  }
+
+  filter->lastRaw = detected;
+  filter->filtered = filtered;
+  return filtered;
+}
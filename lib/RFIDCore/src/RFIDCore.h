@@ -0,0 +1,192 @@
+/**
+  Hardware independent parts of the RFID reader firmware, kept free of
+  Arduino so they can be unit tested natively (pio test -e native)
+
+  GitHub repository:
+    https://github.com/sumnerboy12/OXRS-BJ-RFIDReader-ESP-FW
+
+  Copyright 2022 Ben Jones <ben.jones12@gmail.com>
+*/
+
+#ifndef RFID_CORE_H
+#define RFID_CORE_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*--------------------------- Constants -------------------------------*/
+// Detection timeout, auto-tuned to a percentile of observed response times
+#define     DEFAULT_DETECT_TIMEOUT_MS     5
+#define     MIN_DETECT_TIMEOUT_MS         2
+#define     MAX_DETECT_TIMEOUT_MS         50
+#define     DETECT_TIMEOUT_MARGIN_MS      1
+#define     DETECT_TIMEOUT_PERCENTILE     95
+#define     DETECT_SAMPLES                32
+#define     MIN_DETECT_SAMPLES            8
+
+// Max NFC tag UID length
+#define     MAX_UID_BYTES                 10
+
+// PN532 commands we build frames for ourselves (as defined in PN532.h)
+#ifndef PN532_COMMAND_INLISTPASSIVETARGET
+#define PN532_COMMAND_INLISTPASSIVETARGET   (0x4A)
+#endif
+#ifndef PN532_COMMAND_INDESELECT
+#define PN532_COMMAND_INDESELECT            (0x44)
+#endif
+#ifndef PN532_MIFARE_ISO14443A
+#define PN532_MIFARE_ISO14443A              (0x00)
+#endif
+
+/*--------------------------- Enumerations ----------------------------*/
+// Card types reported by the reader backends
+enum cardType_t { CARD_UNKNOWN, CARD_CLASSIC, CARD_TYPE2, CARD_ISO14443_4, CARD_ISO15693, CARD_TYPE_COUNT };
+
+/*--------------------------- Types -----------------------------------*/
+// A tag found by an inventory scan
+struct ScannedTag
+{
+  uint8_t uid[MAX_UID_BYTES];
+  uint8_t uidLength;
+  uint8_t cardType;
+};
+
+// Queued event, the serialised JSON lives in a shared byte pool
+struct EventSlot
+{
+  uint32_t seq;
+  uint32_t sentMs;
+  uint16_t offset;                    // into the event pool
+  uint16_t length;                    // including the terminator
+  uint8_t attempts;
+  bool sent;
+  bool acked;
+};
+
+// Detection timeout tuner (fixed if configMs is set, otherwise auto-tuned)
+struct DetectTuner
+{
+  uint32_t configMs;
+  uint32_t timeoutMs;
+  uint32_t samplesUs[DETECT_SAMPLES];
+  uint8_t sampleNext;
+  uint8_t sampleCount;
+  uint32_t percentileUs;
+  uint32_t censored;
+
+  // misses since the tag last answered, only counted (as censored) if that
+  // same tag answers again, and the floor those raise the timeout to for a
+  // window of samples
+  uint8_t missPending;
+  uint8_t lastUid[MAX_UID_BYTES];
+  uint8_t lastUidLength;
+  uint32_t floorMs;
+  uint8_t floorHold;
+};
+
+// Presence filter, history holds one bit per poll (newest in bit 0)
+struct PresenceFilter
+{
+  uint8_t window;
+  uint8_t threshold;
+  uint16_t history;
+  bool filtered;
+  bool lastRaw;
+  uint32_t flicker;
+};
+
+/*--------------------------- Functions -------------------------------*/
+uint8_t getCardType(uint8_t sak);
+bool scanAdd(ScannedTag tags[], uint8_t * count, uint8_t maxTags, uint8_t uid[], uint8_t uidLength, uint8_t cardType);
+
+int8_t findNdefTlv(uint8_t data[], uint16_t len, uint16_t * start, uint16_t * length);
+
+uint16_t crc16(uint8_t data[], uint16_t len);
+uint16_t cobsEncode(uint8_t output[], uint8_t input[], uint16_t len);
+
+int32_t eventPoolFit(EventSlot queue[], uint8_t queueSize, uint8_t head, uint8_t count, uint16_t poolBytes, uint16_t length);
+int32_t eventPoolReserve(EventSlot queue[], uint8_t queueSize, uint8_t * head, uint8_t * count, uint16_t poolBytes, uint16_t length, uint32_t * dropped);
+
+void tuneDetectTimeout(DetectTuner * tuner, bool present, bool detected, uint32_t elapsedUs, uint8_t uid[], uint8_t uidLength);
+bool filterPresence(PresenceFilter * filter, bool detected);
+
+/*--------------------------- PN532 Frames ----------------------------*/
+// Templated on the transport so the firmware hands in its PN532Interface
+// and the tests a scripted mock with the same writeCommand/readResponse
+
+template <class Interface>
+bool pn532ListTarget(Interface & bus, uint8_t uid[], uint8_t * uidLength, uint8_t * cardType, uint16_t timeoutMs)
+{
+  // InListPassiveTarget ourselves so we get the SAK as well as the UID
+  uint8_t command[3] = { PN532_COMMAND_INLISTPASSIVETARGET, 1, PN532_MIFARE_ISO14443A };
+  if (bus.writeCommand(command, sizeof(command)) != 0)
+    return false;
+
+  // NbTg, Tg, ATQA (2), SAK, NFCIDLength, NFCID, [ATS]
+  uint8_t response[64];
+  int16_t length = bus.readResponse(response, sizeof(response), timeoutMs);
+  if (length < 6 || response[0] != 1)
+    return false;
+
+  // a truncated frame must not hand back a UID we never received
+  if (response[5] == 0 || response[5] > MAX_UID_BYTES || length < 6 + response[5])
+    return false;
+
+  *cardType = getCardType(response[4]);
+  *uidLength = response[5];
+  memcpy(uid, &response[6], *uidLength);
+  return true;
+}
+
+template <class Interface>
+uint8_t pn532ListTargets(Interface & bus, ScannedTag tags[], uint8_t maxTags, uint16_t timeoutMs)
+{
+  uint8_t count = 0;
+
+  // the PN532 activates at most two tags at a time, so keep listing and
+  // halting them until nothing new answers
+  while (count < maxTags)
+  {
+    uint8_t command[3] = { PN532_COMMAND_INLISTPASSIVETARGET, 2, PN532_MIFARE_ISO14443A };
+    if (bus.writeCommand(command, sizeof(command)) != 0)
+      break;
+
+    // NbTg, then per target Tg, ATQA (2), SAK, NFCIDLength, NFCID, [ATS]
+    uint8_t response[64];
+    int16_t length = bus.readResponse(response, sizeof(response), timeoutMs);
+    if (length < 1 || response[0] == 0)
+      break;
+
+    bool added = false;
+    int16_t i = 1;
+    for (uint8_t target = 0; target < response[0] && target < 2; target++)
+    {
+      if (i + 5 > length || i + 5 + response[i + 4] > length)
+        break;
+
+      uint8_t sak = response[i + 3];
+      uint8_t uidLength = response[i + 4];
+      added |= scanAdd(tags, &count, maxTags, &response[i + 5], uidLength, getCardType(sak));
+      i += 5 + uidLength;
+
+      // ISO14443-4 targets carry their ATS (first byte is its length)
+      if ((sak & 0x20) && i < length) { i += response[i]; }
+    }
+
+    // halt (ISO14443-4 deselect) everything listed so the next pass
+    // finds the rest
+    uint8_t deselect[2] = { PN532_COMMAND_INDESELECT, 0 };
+    if (bus.writeCommand(deselect, sizeof(deselect)) == 0)
+    {
+      uint8_t status[1];
+      bus.readResponse(status, sizeof(status), timeoutMs);
+    }
+
+    if (!added)
+      break;
+  }
+
+  return count;
+}
+
+#endif
@@ -8,10 +8,26 @@
 */
 
 /*--------------------------- Libraries -------------------------------*/
+#if defined(OXRS_ESP8266)
 #include <SoftwareSerial.h>
-#include <NfcAdapter.h>
-#include <PN532/PN532/PN532.h>
+#endif
+#include <NfcTag.h>
+
+// PN532 is the default reader backend
+#if !defined(USE_RC522_NFC) && !defined(USE_PN5180_NFC)
+#define USE_PN532_NFC
+#endif
 
+#if defined(USE_RC522_NFC)
+#include <SPI.h>
+#include <MFRC522.h>
+#elif defined(USE_PN5180_NFC)
+#include <SPI.h>
+#include <PN5180.h>
+#include <PN5180ISO15693.h>
+#else
+#include <MifareClassic.h>
+#include <PN532/PN532/PN532.h>
 #ifdef USE_I2C_NFC
 #include <Wire.h>
 #include <PN532/PN532_I2C/PN532_I2C.h>
@@ -19,178 +35,3832 @@
 #include <SPI.h>
 #include <PN532/PN532_SPI/PN532_SPI.h>
 #endif
+#endif
+
+#include <LittleFS.h>                 // on-flash access log
+#include <RFIDCore.h>                 // tag parsing, framing and detect tuning
+
+#if defined(OXRS_ESP8266)
+#include <cont.h>                     // ESP8266 cont stack painting
+#endif
+
+#if defined(OXRS_ESP32)
+#include <OXRS_32.h>                  // ESP32 support
+OXRS_32 oxrs;
+
+#elif defined(OXRS_ESP8266)
+#include <OXRS_8266.h>                // ESP8266 support
+OXRS_8266 oxrs;
+
+#endif
+
+/*--------------------------- Constants -------------------------------*/
+// Serial
+#define     SERIAL_BAUD_RATE              115200
+
+// Binary tag events over serial for wired hosts (build with -DSERIAL_EVENTS)
+#ifndef SERIAL_EVENT_BAUD_RATE
+#define     SERIAL_EVENT_BAUD_RATE        921600
+#endif
+#define     SERIAL_EVENT_TAG_ARRIVED      0x01
+#define     SERIAL_EVENT_TAG_REMOVED      0x02
+
+// Time between tag reads
+#define     DEFAULT_TAG_READ_INTERVAL_MS  200
+
+// PN532 RF retry/analog defaults (MxRtyPassiveActivation, CIU_RFCfg RxGain)
+#define     DEFAULT_RF_MAX_RETRIES        0xFF
+#define     DEFAULT_RF_RX_GAIN            5
+
+// RF calibration sweep
+#define     CALIBRATION_ATTEMPTS          10
+#define     CALIBRATION_STEPS             7
+
+// Presence filter defaults (tag present while N of the last M polls detected it)
+#define     DEFAULT_PRESENCE_WINDOW       3
+#define     DEFAULT_PRESENCE_THRESHOLD    1
+#define     MAX_PRESENCE_WINDOW           16
+
+// Reader backend pins (SPI backends share SPI_SS_PIN as chip select)
+#if defined(OXRS_ESP8266)
+#ifndef SPI_SS_PIN
+#define     SPI_SS_PIN                    D8
+#endif
+#ifndef RC522_RST_PIN
+#define     RC522_RST_PIN                 D3
+#endif
+#ifndef PN5180_BUSY_PIN
+#define     PN5180_BUSY_PIN               D2
+#endif
+#ifndef PN5180_RST_PIN
+#define     PN5180_RST_PIN                D3
+#endif
+#else
+#ifndef SPI_SS_PIN
+#define     SPI_SS_PIN                    SS
+#endif
+#ifndef RC522_RST_PIN
+#define     RC522_RST_PIN                 4
+#endif
+#ifndef PN5180_BUSY_PIN
+#define     PN5180_BUSY_PIN               5
+#endif
+#ifndef PN5180_RST_PIN
+#define     PN5180_RST_PIN                4
+#endif
+#endif
+
+// Reader backend capability flags, each one switches a part of the pipeline
+#define     READER_CAP_NDEF               0x01    // can read NDEF, otherwise UID only
+#define     READER_CAP_RF_TUNING          0x02    // RF retry/gain config and calibration
+#define     READER_CAP_DETECT_TIMEOUT     0x04    // honours the detect timeout, so it can be tuned
+#define     READER_CAP_INVENTORY          0x08    // can scan for every tag in the field at once
+#define     READER_CAP_COUNT              4
+
+// Largest NDEF area we buffer while reading a tag
+#define     TAG_DATA_BYTES                1024
+
+// NFC Forum Type 2 tags (Ultralight/NTAG), user data starts at page 4
+#define     TYPE2_FIRST_DATA_PAGE         4
+#define     TAG_TYPE_TYPE2                "NFC Forum Type 2"
+
+// Cached controller access decisions
+#define     DECISION_CACHE_SIZE           16
+#define     DEFAULT_DECISION_TTL_SECS     60
+#define     MAX_DECISION_TTL_SECS         2073600   // 24 days, well inside the millis() wrap
+
+// Pre-read tag filter rules
+#define     MAX_FILTER_RULES              8
+
+// How long a partial read is kept for the same tag to come back
+#define     RESUME_WINDOW_MS              3000
+
+// Inventory mode, tags tracked and how long a tag can go unseen
+#define     INVENTORY_SIZE                32
+#define     INVENTORY_SCAN_MAX            16      // tags found in a single scan
+#define     INVENTORY_SLOT_US             5000    // ISO15693 slot, time for a 26kbps response
+#define     DEFAULT_INVENTORY_SNAPSHOT    10
+#define     DEFAULT_INVENTORY_TIMEOUT_MS  2000
+
+// Usage aggregation mode, UIDs counted per summary period
+#ifndef USAGE_TABLE_SIZE
+#define     USAGE_TABLE_SIZE              32
+#endif
+
+// On-flash access log, fixed-size records appended to segment files with
+// a sparse time index (one key per ACCESS_LOG_INDEX_EVERY records) in RAM
+#define     ACCESS_LOG_DIR                "/log"
+#define     ACCESS_LOG_SEGMENTS           8
+#define     ACCESS_LOG_SEGMENT_RECORDS    1024
+#define     ACCESS_LOG_INDEX_EVERY        64
+#define     ACCESS_LOG_QUERY_LIMIT        500
+#define     ACCESS_LOG_REJECTED           0x01
+#define     ACCESS_LOG_BUFFER_RECORDS     16      // held in RAM until after publishing
+#define     DEFAULT_LOG_BENCHMARK_RECORDS 1000
+#define     MAX_LOG_BENCHMARK_RECORDS     5000
+#define     LOG_BENCHMARK_SEEKS           100
+
+// Wall clock for access log timestamps, anything earlier is "not set yet"
+#ifndef NTP_SERVER
+#define     NTP_SERVER                    "pool.ntp.org"
+#endif
+#define     TIME_VALID_SECS               1600000000L
+
+// Fault injection (build with -DFAULT_INJECTION), rates are per mille, a
+// sweep runs the configured rates scaled from 0 to 100% in equal steps
+#define     FAULT_RATE_SCALE              1000
+#define     FAULT_SWEEP_STEPS             5
+#define     DEFAULT_FAULT_SWEEP_POLLS     50
+#define     MAX_FAULT_SWEEP_POLLS         500
+
+// Per-tap arena for JSON and payload temporaries (reset after each publish)
+#define     TAG_ARENA_BYTES               8192
+
+// Time between stats telemetry publishes
+#define     DEFAULT_STATS_INTERVAL_MS     60000
+
+// How often the broker is probed while publishes are failing
+#define     MQTT_PROBE_INTERVAL_MS        1000
+
+// Events held (serialised, back to back in a byte pool) for in-order replay
+// when publishing fails, or until acked (override at build time to trade
+// memory for a bigger window)
+#ifndef EVENT_QUEUE_SIZE
+#define     EVENT_QUEUE_SIZE              16
+#endif
+#ifndef EVENT_POOL_BYTES
+#if defined(OXRS_ESP32)
+#define     EVENT_POOL_BYTES              16384
+#else
+#define     EVENT_POOL_BYTES              6144
+#endif
+#endif
+
+// Largest single event we hold, it has to deserialise back into the arena
+#define     EVENT_MAX_BYTES               (TAG_ARENA_BYTES / 2)
+
+// Acknowledged delivery defaults (window of 0 disables acks)
+#define     DEFAULT_ACK_WINDOW            0
+#define     DEFAULT_ACK_TIMEOUT_MS        5000
+
+// Number of distinct call sites the allocation tracker can record
+#define     ALLOC_TRACKER_SITES           16
+
+// Stack available to loop() and the usage we warn at
+#if defined(OXRS_ESP8266)
+#define     LOOP_STACK_BYTES              CONT_STACKSIZE
+#else
+#define     LOOP_STACK_BYTES              CONFIG_ARDUINO_LOOP_STACK_SIZE
+#endif
+#define     STACK_WARN_BYTES              (LOOP_STACK_BYTES * 3 / 4)
+
+// Benchmark report interval (build with -DBENCHMARK)
+#ifndef BENCHMARK_INTERVAL_MS
+#define     BENCHMARK_INTERVAL_MS         10000
+#endif
+
+// Number of span events kept for timeline export, idle work quicker than
+// SPAN_MIN_US isn't kept, and a tap slower than SPAN_FREEZE_MS freezes the
+// buffer (until exported, or for SPAN_FREEZE_HOLD_MS) so it can be fetched
+#define     SPAN_BUFFER_SIZE              128
+#define     SPAN_MIN_US                   1000
+#define     SPAN_FREEZE_MS                100
+#define     SPAN_FREEZE_HOLD_MS           60000
+
+// Number of recently seen tags we keep content digests for
+#define     TAG_CACHE_SIZE                16
+
+// Number of records per tag we keep digests for (for delta publishing)
+#define     MAX_CACHED_RECORDS            8
+
+// NFC Forum URI record identifier codes (0x00 - 0x23)
+#define     URI_PREFIX_COUNT              36
+
+// Soak testing (build with -DVIRTUAL_CLOCK), the clock starts this close
+// to the 32-bit millis() wrap, and the invariants we check against
+#ifndef VIRTUAL_CLOCK_START_MS
+#define     VIRTUAL_CLOCK_START_MS        (0xFFFFFFFFUL - 120000UL)
+#endif
+#define     SOAK_HEAP_MARGIN_BYTES        2048
+#define     SOAK_MAX_LOOP_MS              1000
+#define     MAX_CLOCK_SPEED               1000
+
+/*--------------------------- Virtual Clock ---------------------------*/
+#ifdef VIRTUAL_CLOCK
+// Everything below sees millis() through a virtual clock that can run
+// faster than real time (clockSpeed) and be skipped forward (clockSkipMs),
+// libraries keep the real clock
+uint32_t clockVirtualMs = VIRTUAL_CLOCK_START_MS;
+uint32_t clockLastRealMs = 0L;
+uint16_t clockSpeed = 1;
+
+uint32_t virtualMillis()
+{
+  uint32_t realMs = millis();
+  clockVirtualMs += (realMs - clockLastRealMs) * clockSpeed;
+  clockLastRealMs = realMs;
+  return clockVirtualMs;
+}
+
+#define millis() virtualMillis()
+#endif
+
+/*--------------------------- Enums -----------------------------------*/
+// Tag processing pipeline phases
+enum pipelinePhase_t { PHASE_DETECT, PHASE_READ, PHASE_PARSE, PHASE_SERIALIZE, PHASE_PUBLISH, PHASE_COUNT };
+const char * PHASE_NAMES[PHASE_COUNT] = { "detect", "read", "parse", "serialize", "publish" };
+
+// Timeline spans (pipeline phases plus the other work done in loop())
+enum spanId_t { SPAN_OXRS = PHASE_COUNT, SPAN_STATS, SPAN_COUNT };
+const char * SPAN_NAMES[SPAN_COUNT] = { "detect", "read", "parse", "serialize", "publish", "oxrs", "stats" };
+
+// Card type names, indexed by cardType_t
+const char * CARD_TYPE_NAMES[CARD_TYPE_COUNT] = { "unknown", "classic", "type2", "iso14443-4", "iso15693" };
+
+// Reader capability names, one per flag bit
+const char * READER_CAP_NAMES[READER_CAP_COUNT] = { "ndef", "rfTuning", "detectTimeout", "inventory" };
+
+/*--------------------------- Reader Backends -------------------------*/
+// Everything the tag pipeline needs from a reader chip
+class ReaderBackend
+{
+  public:
+    virtual const char * name() = 0;
+    virtual uint8_t capabilities() = 0;
+    virtual bool begin() = 0;
+    virtual bool detect(byte uid[], uint8_t * uidLength, uint8_t * cardType, uint16_t timeoutMs) = 0;
+
+    // every tag in the field, readers without READER_CAP_INVENTORY only
+    // ever see the one that answers first
+    virtual uint8_t scan(ScannedTag tags[], uint8_t maxTags, uint16_t timeoutMs)
+    {
+      if (maxTags == 0 || !detect(tags[0].uid, &tags[0].uidLength, &tags[0].cardType, timeoutMs))
+        return 0;
+      return 1;
+    }
+
+    virtual bool read(byte uid[], uint8_t uidLength, uint8_t cardType, NfcTag * tag) { return false; }
+    virtual bool applyRFConfig() { return false; }
+};
+
+/*--------------------------- Lookups ---------------------------------*/
+const char * URI_PREFIXES[URI_PREFIX_COUNT] = 
+{
+  "", "http://www.", "https://www.", "http://", "https://", "tel:", "mailto:", 
+  "ftp://anonymous:anonymous@", "ftp://ftp.", "ftps://", "sftp://", "smb://", 
+  "nfs://", "ftp://", "dav://", "news:", "telnet://", "imap:", "rtsp://", "urn:", 
+  "pop:", "sip:", "sips:", "tftp:", "btspp://", "btl2cap://", "btgoep://", 
+  "tcpobex://", "irdaobex://", "file://", "urn:epc:id:", "urn:epc:tag:", 
+  "urn:epc:pat:", "urn:epc:raw:", "urn:epc:", "urn:nfc:"
+};
+
+// CRC-32 (reflected 0xEDB88320) nibble table
+const uint32_t CRC32_TABLE[16] = 
+{
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+// MxRtyPassiveActivation values swept during calibration (cheapest first)
+const uint8_t CALIBRATION_RETRIES[CALIBRATION_STEPS] = { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20 };
+
+// PN532 analog settings for 106 kbps type A (RFConfiguration CfgItem 0x0A)
+const uint8_t RF_ANALOG_106A[11] = { 0x59, 0xF4, 0x3F, 0x11, 0x4D, 0x85, 0x61, 0x6F, 0x26, 0x62, 0x87 };
+
+/*--------------------------- Instantiate Globals ---------------------*/
+#ifdef FAULT_INJECTION
+#ifndef USE_PN532_NFC
+#error "FAULT_INJECTION is only supported with the PN532 reader"
+#endif
+
+// Injected fault types
+enum fault_t { FAULT_NAK, FAULT_CHECKSUM, FAULT_TIMEOUT, FAULT_TRUNCATE, FAULT_STRETCH, FAULT_TAG_LEAVE, FAULT_COUNT };
+const char * FAULT_NAMES[FAULT_COUNT] = { "nak", "checksum", "timeout", "truncate", "stretch", "tagLeave" };
+
+// Configured fault rates (per mille of transfers) and the stretch delay
+uint16_t faultRates[FAULT_COUNT];
+uint16_t faultStretchUs = 0;
+
+// Faults injected, and time from a fault to the next successful detection
+uint32_t faultsInjected[FAULT_COUNT];
+uint32_t faultSinceMs = 0L;
+uint32_t faultRecoveries = 0L;
+uint32_t faultRecoveryTotalMs = 0L;
+uint32_t faultRecoveryMaxMs = 0L;
+
+// Polls per step of a requested fault sweep
+uint16_t faultSweepPending = 0;
+
+// Sits between the PN532 driver and the real bus, misbehaving on demand
+// like marginal hardware does (bad wiring, long cables, tags at the edge)
+class FaultInjectingInterface : public PN532Interface
+{
+  public:
+    FaultInjectingInterface(PN532Interface & inner) : _inner(inner) {}
+
+    void begin() { _inner.begin(); }
+    void wakeup() { _inner.wakeup(); }
+
+    int8_t writeCommand(const uint8_t * header, uint8_t hlen, const uint8_t * body = 0, uint8_t blen = 0)
+    {
+      _command = header[0];
+      stretch();
+
+      if (inject(FAULT_NAK))
+        return PN532_INVALID_ACK;
+
+      return _inner.writeCommand(header, hlen, body, blen);
+    }
+
+    int16_t readResponse(uint8_t buf[], uint8_t len, uint16_t timeout = 1000)
+    {
+      stretch();
+
+      // always drain the real response so the PN532 stays in step
+      uint32_t startMs = millis();
+      int16_t result = _inner.readResponse(buf, len, timeout);
+      if (result < 0)
+        return result;
+
+      if (inject(FAULT_TIMEOUT))
+      {
+        while ((millis() - startMs) < timeout) { yield(); }
+        return PN532_TIMEOUT;
+      }
+
+      if (inject(FAULT_CHECKSUM))
+      {
+        if (result > 0) { buf[random(result)] ^= 0xFF; }
+        return PN532_INVALID_FRAME;
+      }
+
+      if (result > 1 && inject(FAULT_TRUNCATE))
+        return random(1, result);
+
+      // the tag "leaves" part way through a read, so exchanges fail with
+      // a target timeout until a detection sees it gone
+      if (_command == PN532_COMMAND_INDATAEXCHANGE && (_tagGone || inject(FAULT_TAG_LEAVE)))
+      {
+        _tagGone = true;
+        buf[0] = 0x01;
+        return 1;
+      }
+
+      if (_command == PN532_COMMAND_INLISTPASSIVETARGET)
+      {
+        if (_tagGone)
+        {
+          _tagGone = false;
+          buf[0] = 0x00;
+          return 1;
+        }
+
+        // a target was found, so we have recovered from any fault
+        if (buf[0] > 0 && faultSinceMs > 0)
+        {
+          uint32_t recoveryMs = millis() - faultSinceMs;
+          faultRecoveries++;
+          faultRecoveryTotalMs += recoveryMs;
+          faultRecoveryMaxMs = max(faultRecoveryMaxMs, recoveryMs);
+          faultSinceMs = 0L;
+        }
+      }
+
+      return result;
+    }
+
+  private:
+    PN532Interface & _inner;
+    uint8_t _command = 0;
+    bool _tagGone = false;
+
+    bool inject(uint8_t fault)
+    {
+      if (faultRates[fault] == 0 || random(FAULT_RATE_SCALE) >= faultRates[fault])
+        return false;
+
+      faultsInjected[fault]++;
+      if (faultSinceMs == 0) { faultSinceMs = max((uint32_t)millis(), (uint32_t)1); }
+      return true;
+    }
+
+    void stretch()
+    {
+      // a slave holding SCL low delays the whole transfer
+      if (faultStretchUs > 0 && inject(FAULT_STRETCH))
+      {
+        delayMicroseconds(faultStretchUs);
+      }
+    }
+};
+#endif
+
+// RFID reader
+#if defined(USE_RC522_NFC)
+MFRC522 mfrc522(SPI_SS_PIN, RC522_RST_PIN);
+#elif defined(USE_PN5180_NFC)
+PN5180ISO15693 pn5180(SPI_SS_PIN, PN5180_BUSY_PIN, PN5180_RST_PIN);
+#else
+#ifdef USE_I2C_NFC
+PN532_I2C pn532_i2c(Wire);
+PN532Interface & pn532Bus = pn532_i2c;
+#else
+PN532_SPI pn532_spi(SPI, SPI_SS_PIN);
+PN532Interface & pn532Bus = pn532_spi;
+#endif
+#ifdef FAULT_INJECTION
+FaultInjectingInterface pn532Faults(pn532Bus);
+PN532Interface & pn532If = pn532Faults;
+#else
+PN532Interface & pn532If = pn532Bus;
+#endif
+PN532 pn532 = PN532(pn532If);
+#endif
+
+// Tag data read so far, kept between polls so an interrupted read can resume
+byte tagData[TAG_DATA_BYTES];
+
+// PN532 RF settings, applied from loop() whenever they change
+uint8_t rfMaxRetries = DEFAULT_RF_MAX_RETRIES;
+uint8_t rfRxGain = DEFAULT_RF_RX_GAIN;
+bool rfConfigPending = false;
+bool calibrationPending = false;
+
+// Last tag read and when
+uint32_t tagReadIntervalMs = DEFAULT_TAG_READ_INTERVAL_MS;
+uint32_t lastTagReadMs = 0L;
+byte lastUid[MAX_UID_BYTES];
+
+// Tag that has arrived (allowed by the filter) but not yet left, whether or
+// not it has been read yet
+byte arrivalUid[MAX_UID_BYTES];
+uint8_t arrivalUidLength = 0;
+
+// Detection timeout (fixed if configured, otherwise auto-tuned)
+DetectTuner detectTuner = { 0L, DEFAULT_DETECT_TIMEOUT_MS };
+
+// Presence filter (tag present while N of the last M polls detected it)
+PresenceFilter presence = { DEFAULT_PRESENCE_WINDOW, DEFAULT_PRESENCE_THRESHOLD };
+
+// Pre-read filter chain, first matching rule decides
+struct FilterRule
+{
+  bool allow;
+  int8_t cardType;
+  uint8_t uidLength;
+  uint8_t prefixLength;
+  byte prefix[MAX_UID_BYTES];
+  byte mask[MAX_UID_BYTES];
+};
+
+FilterRule filterRules[MAX_FILTER_RULES];
+uint8_t filterRuleCount = 0;
+bool filterDefaultAllow = true;
+uint32_t tagsRejected = 0L;
+
+// Controller access decisions, so repeat taps can be decided locally
+struct Decision
+{
+  byte uid[MAX_UID_BYTES];
+  uint8_t uidLength;
+  bool allow;
+  uint32_t storedMs;
+  uint32_t ttlMs;
+};
+
+Decision decisionCache[DECISION_CACHE_SIZE];
+uint32_t decisionTtlSecs = DEFAULT_DECISION_TTL_SECS;
+uint32_t decisionHits = 0L;
+uint32_t decisionMisses = 0L;
+uint32_t decisionSavedMs = 0L;
+uint32_t decisionRttMs = 0L;
+
+// Last tag published, to time the controller's decision round trip
+byte decisionPendingUid[MAX_UID_BYTES];
+uint8_t decisionPendingUidLength = 0;
+uint32_t decisionPendingMs = 0L;
+
+// Partial Type 2 read state (see tagData)
+byte resumeUid[MAX_UID_BYTES];
+uint8_t resumeUidLength = 0;
+uint16_t resumePagesRead = 0;
+uint16_t resumePagesTotal = 0;
+uint32_t resumeLastMs = 0L;
+uint32_t readsInterrupted = 0L;
+uint32_t readsResumed = 0L;
+uint32_t tagsRead = 0L;
+
+// Binary serial events
+uint32_t serialEventCount = 0L;
+
+// What is currently on the reader (a zero UID length means nothing)
+byte padUid[MAX_UID_BYTES];
+uint8_t padUidLength = 0;
+uint32_t padSinceMs = 0L;
+uint32_t padDigest = 0L;
+bool padDigestValid = false;
+
+// Re-send the reader state once the broker is (back) up, so consumers that
+// subscribed while we were offline still see where things are
+bool padStatePending = true;
+
+// Inventory of tags sitting on the reader, reported as deltas every
+// inventoryIntervalMs with a full snapshot every inventorySnapshotEvery
+struct InventoryEntry
+{
+  byte uid[MAX_UID_BYTES];
+  uint8_t uidLength;
+  uint32_t lastSeenMs;
+  bool reported;
+};
+
+InventoryEntry inventory[INVENTORY_SIZE];
+uint8_t inventoryCount = 0;
+uint32_t inventoryIntervalMs = 0L;
+uint32_t inventoryTimeoutMs = DEFAULT_INVENTORY_TIMEOUT_MS;
+uint16_t inventorySnapshotEvery = DEFAULT_INVENTORY_SNAPSHOT;
+uint16_t inventoryReports = 0;
+uint32_t lastInventoryMs = 0L;
+uint32_t inventoryOverflow = 0L;
+
+// Tags found by the last inventory scan
+ScannedTag scannedTags[INVENTORY_SCAN_MAX];
+uint8_t scannedCount = 0;
+
+// Per-UID tap counts for usage summaries, a space-saving table so the
+// heaviest hitters survive when it fills (count may overestimate by error)
+struct UsageEntry
+{
+  byte uid[MAX_UID_BYTES];
+  uint8_t uidLength;
+  uint32_t count;
+  uint32_t error;
+  uint32_t firstSeenMs;
+  uint32_t lastSeenMs;
+};
+
+UsageEntry usageTable[USAGE_TABLE_SIZE];
+uint8_t usageCount = 0;
+uint32_t usageIntervalMs = 0L;
+uint32_t usagePeriodStartMs = 0L;
+uint32_t usageTaps = 0L;
+uint32_t usageEvicted = 0L;
+
+// Access log record, written as-is so the layout must not change
+struct __attribute__((packed)) AccessLogRecord
+{
+  uint32_t timeSecs;                  // unix time, 0 if the clock wasn't set
+  uint32_t uptimeMs;
+  byte uid[MAX_UID_BYTES];
+  uint8_t uidLength;
+  uint8_t cardType;
+  uint8_t flags;
+  uint8_t reserved[3];
+};
+
+static_assert(sizeof(AccessLogRecord) == 24, "access log record layout changed");
+
+// Access log segments, oldest first from accessLogHead, keys[] hold the
+// running max timestamp at the start of each index block
+struct AccessLogSegment
+{
+  uint32_t id;
+  uint16_t records;
+  uint32_t keys[ACCESS_LOG_SEGMENT_RECORDS / ACCESS_LOG_INDEX_EVERY];
+};
+
+AccessLogSegment accessLogSegments[ACCESS_LOG_SEGMENTS];
+uint8_t accessLogHead = 0;
+uint8_t accessLogSegmentCount = 0;
+uint32_t accessLogMaxTime = 0L;
+bool accessLogEnabled = false;
+bool accessLogMounted = false;
+
+// Taps waiting to be written, so flash writes stay off the tap-to-publish path
+AccessLogRecord accessLogBuffer[ACCESS_LOG_BUFFER_RECORDS];
+uint8_t accessLogBuffered = 0;
+
+// Access log timings, for comparing flash/filesystem performance
+uint32_t accessLogAppends = 0L;
+uint32_t accessLogAppendTotalUs = 0L;
+uint32_t accessLogAppendMaxUs = 0L;
+uint32_t accessLogErrors = 0L;
+uint32_t accessLogQueries = 0L;
+uint32_t accessLogQueryLastUs = 0L;
+uint32_t accessLogQueryMaxUs = 0L;
+uint32_t accessLogQueryScanned = 0L;
+
+// Requested access log benchmark, run from loop()
+uint32_t logBenchmarkPending = 0L;
+
+// Only publish uid+digest for re-presented tags with unchanged content
+bool publishOnChange = false;
+
+// Only publish the records added, removed or changed since the last read
+bool publishRecordDeltas = false;
+
+// Content digests of recently seen tags
+struct TagCacheEntry
+{
+  byte uid[MAX_UID_BYTES];
+  uint8_t uidLength;
+  uint32_t digest;
+  bool digestValid;
+  uint32_t lastSeenMs;
+  uint8_t recordCount;
+  uint32_t recordDigest[MAX_CACHED_RECORDS];
+  uint8_t recordDigestValid;          // one bit per record digest
+};
+
+TagCacheEntry tagCache[TAG_CACHE_SIZE];
+
+// Broker link, inferred from publish results (the OXRS library owns the client)
+bool mqttDown = false;
+bool mqttEverUp = false;
+uint32_t mqttDownSinceMs = 0L;
+uint32_t mqttLastUpMs = 0L;
+uint32_t mqttLastProbeMs = 0L;
+uint32_t mqttFailures = 0L;
+uint32_t mqttReconnects = 0L;
+uint32_t mqttLastOutageMs = 0L;
+uint32_t mqttLastRecoveryMs = 0L;
+
+// Event sequence numbers and the queue of events still to be published
+// (or, with acks enabled, still to be acked)
+uint32_t eventSeq = 0L;
+EventSlot eventQueue[EVENT_QUEUE_SIZE];
+char eventPool[EVENT_POOL_BYTES];
+uint8_t eventQueueHead = 0;
+uint8_t eventQueueCount = 0;
+uint32_t eventsDropped = 0L;
+uint32_t eventsRetransmitted = 0L;
+bool eventsResendPending = false;
+uint32_t lastEventDrainMs = 0L;
+
+uint8_t ackWindow = DEFAULT_ACK_WINDOW;
+uint32_t ackTimeoutMs = DEFAULT_ACK_TIMEOUT_MS;
+
+// Per-tap arena, reserved at boot so tag processing never fragments the heap
+uint8_t tagArena[TAG_ARENA_BYTES] __attribute__((aligned(4)));
+size_t tagArenaUsed = 0;
+
+/*--------------------------- Tag Arena -------------------------------*/
+void * tagArenaAlloc(size_t size)
+{
+  // keep every allocation 4-byte aligned
+  size = (size + 3) & ~((size_t)3);
+
+  if (tagArenaUsed + size > TAG_ARENA_BYTES)
+    return NULL;
+
+  void * ptr = &tagArena[tagArenaUsed];
+  tagArenaUsed += size;
+  return ptr;
+}
+
+void tagArenaReset()
+{
+  // everything allocated for the last tap is released in one go
+  tagArenaUsed = 0;
+}
+
+// ArduinoJson allocator backed by the tag arena
+struct TagArenaAllocator
+{
+  void * allocate(size_t size) { return tagArenaAlloc(size); }
+  void deallocate(void * ptr) { }
+  void * reallocate(void * ptr, size_t size) { return ptr; }
+};
+
+typedef BasicJsonDocument<TagArenaAllocator> TagJsonDocument;
+
+// Stats telemetry
+uint32_t statsIntervalMs = DEFAULT_STATS_INTERVAL_MS;
+uint32_t lastStatsMs = 0L;
+
+// Stack high-water (bytes used) per pipeline phase
+uint32_t stackHighWater[PHASE_COUNT];
+uint8_t currentPhase = PHASE_COUNT;
+
+#ifdef VIRTUAL_CLOCK
+// Soak invariants, checked at the end of every loop()
+enum soakCheck_t { SOAK_ARENA, SOAK_HEAP, SOAK_LOOP, SOAK_STACK, SOAK_QUEUE, SOAK_CHECK_COUNT };
+const char * SOAK_CHECK_NAMES[SOAK_CHECK_COUNT] = { "arena", "heap", "loop", "stack", "queue" };
+
+uint32_t soakViolations[SOAK_CHECK_COUNT];
+uint32_t soakArenaFlagged = 0L;
+uint32_t soakStackFlagged[PHASE_COUNT];
+uint32_t soakHeapBaseline = 0L;
+uint32_t soakHeapMin = 0L;
+uint32_t soakLoopMaxMs = 0L;
+uint32_t soakLastMs = 0L;
+uint32_t soakWraps = 0L;
+#endif
+
+#ifdef BENCHMARK
+// Per-phase timings since the last benchmark report
+struct PhaseTiming
+{
+  uint32_t count;
+  uint32_t totalUs;
+  uint32_t maxUs;
+};
+
+PhaseTiming phaseTimings[PHASE_COUNT];
+uint32_t phaseStartUs = 0L;
+uint32_t lastBenchmarkMs = 0L;
+#endif
+
+// Span ring buffer, oldest entries are overwritten
+struct Span
+{
+  uint32_t cycles;
+  uint32_t ms;                        // coarse time, to unwrap cycles across gaps
+  uint8_t id;
+  uint8_t begin;
+};
+
+Span spans[SPAN_BUFFER_SIZE];
+uint16_t spanNext = 0;
+uint16_t spanCount = 0;
+bool spansFrozen = false;
+uint32_t spansFrozenMs = 0L;
+
+/*--------------------------- Span Buffer -----------------------------*/
+void spanRecord(uint8_t id, uint8_t begin)
+{
+  if (spansFrozen)
+    return;
+
+  Span * span = &spans[spanNext];
+  span->cycles = ESP.getCycleCount();
+  span->ms = millis();
+  span->id = id;
+  span->begin = begin;
+
+  spanNext = (spanNext + 1) % SPAN_BUFFER_SIZE;
+  if (spanCount < SPAN_BUFFER_SIZE) { spanCount++; }
+}
+
+void spanBegin(uint8_t id) { spanRecord(id, 1); }
+void spanEnd(uint8_t id) { spanRecord(id, 0); }
+
+void spanDiscard(uint8_t id)
+{
+  // drop the span just recorded for id, idle work would otherwise flush
+  // the buffer within milliseconds
+  if (spansFrozen || spanCount < 2)
+    return;
+
+  Span * end = &spans[(spanNext + SPAN_BUFFER_SIZE - 1) % SPAN_BUFFER_SIZE];
+  Span * begin = &spans[(spanNext + SPAN_BUFFER_SIZE - 2) % SPAN_BUFFER_SIZE];
+  if (begin->id != id || !begin->begin || end->id != id || end->begin)
+    return;
+
+  spanNext = (spanNext + SPAN_BUFFER_SIZE - 2) % SPAN_BUFFER_SIZE;
+  spanCount -= 2;
+}
+
+void spanFreezeIfSlow(uint32_t startUs)
+{
+  // keep the timeline of a slow tap until someone fetches it
+  if (spansFrozen || (micros() - startUs) < (SPAN_FREEZE_MS * 1000UL))
+    return;
+
+  spansFrozen = true;
+  spansFrozenMs = millis();
+}
+
+/*--------------------------- MQTT ------------------------------------*/
+bool mqttPublished(bool success)
+{
+  if (!success)
+  {
+    // failures before the first good publish are just OXRS still
+    // connecting after boot, not an outage
+    mqttFailures++;
+    if (!mqttDown && mqttEverUp)
+    {
+      mqttDown = true;
+      mqttDownSinceMs = millis();
+    }
+  }
+  else if (mqttDown)
+  {
+    // first successful publish after an outage, the link may have dropped
+    // any time after the last good publish so time the outage from there
+    mqttDown = false;
+    mqttReconnects++;
+    mqttLastOutageMs = millis() - mqttLastUpMs;
+    mqttLastRecoveryMs = millis() - mqttDownSinceMs;
+
+    // resend anything still awaiting an ack, and the current reader state
+    eventsResendPending = true;
+    padStatePending = true;
+
+    oxrs.print(F("[rfid] broker back after "));
+    oxrs.print(mqttLastOutageMs);
+    oxrs.println(F("ms"));
+  }
+
+  if (success)
+  {
+    mqttEverUp = true;
+    mqttLastUpMs = millis();
+  }
+  return success;
+}
+
+bool mqttPublishStatus(JsonVariant json)
+{
+  return mqttPublished(oxrs.publishStatus(json));
+}
+
+bool mqttPublishTelemetry(JsonVariant json)
+{
+  return mqttPublished(oxrs.publishTelemetry(json));
+}
+
+/*--------------------------- Event Queue -----------------------------*/
+EventSlot * eventQueueSlot(uint8_t index)
+{
+  return &eventQueue[(eventQueueHead + index) % EVENT_QUEUE_SIZE];
+}
+
+void eventQueuePush(JsonVariant json, bool sent)
+{
+  // too big to ever hold, don't throw away queued events for it
+  size_t length = measureJson(json) + 1;
+  if (length > EVENT_MAX_BYTES || length > EVENT_POOL_BYTES)
+  {
+    eventsDropped++;
+    return;
+  }
+
+  // make room by dropping the oldest
+  int32_t offset = eventPoolReserve(eventQueue, EVENT_QUEUE_SIZE, &eventQueueHead, &eventQueueCount, EVENT_POOL_BYTES, length, &eventsDropped);
+
+  EventSlot * slot = eventQueueSlot(eventQueueCount);
+  slot->offset = offset;
+  slot->length = length;
+  serializeJson(json, &eventPool[offset], length);
+  slot->seq = json["seq"];
+  slot->sent = sent;
+  slot->sentMs = millis();
+  slot->attempts = sent ? 1 : 0;
+  slot->acked = false;
+  eventQueueCount++;
+}
+
+void eventQueuePopAcked()
+{
+  while (eventQueueCount > 0 && eventQueueSlot(0)->acked)
+  {
+    eventQueueHead = (eventQueueHead + 1) % EVENT_QUEUE_SIZE;
+    eventQueueCount--;
+  }
+}
+
+uint8_t eventQueueInFlight()
+{
+  uint8_t inFlight = 0;
+  for (uint8_t i = 0; i < eventQueueCount; i++)
+  {
+    EventSlot * slot = eventQueueSlot(i);
+    if (slot->sent && !slot->acked) { inFlight++; }
+  }
+  return inFlight;
+}
+
+bool eventQueueUnsent()
+{
+  for (uint8_t i = 0; i < eventQueueCount; i++)
+  {
+    if (!eventQueueSlot(i)->sent)
+      return true;
+  }
+  return false;
+}
+
+void eventQueueAck(uint32_t seq)
+{
+  for (uint8_t i = 0; i < eventQueueCount; i++)
+  {
+    EventSlot * slot = eventQueueSlot(i);
+    if (slot->seq == seq) { slot->acked = true; }
+  }
+
+  eventQueuePopAcked();
+}
+
+void eventQueueDrain()
+{
+  // anything sent before a reconnect may never have arrived
+  if (eventsResendPending)
+  {
+    eventsResendPending = false;
+    for (uint8_t i = 0; i < eventQueueCount; i++)
+    {
+      eventQueueSlot(i)->sent = false;
+    }
+  }
+
+  // walk the queue in order, (re)sending whatever is due
+  uint8_t inFlight = 0;
+  for (uint8_t i = 0; i < eventQueueCount; i++)
+  {
+    EventSlot * slot = eventQueueSlot(i);
+    if (slot->acked)
+      continue;
+
+    // still waiting on the ack for this one
+    if (slot->sent && (millis() - slot->sentMs) < ackTimeoutMs)
+    {
+      inFlight++;
+      continue;
+    }
+
+    if (ackWindow > 0 && inFlight >= ackWindow)
+      break;
+
+    // deserialise from a const buffer so the slot survives a failed attempt,
+    // and give back the arena space after (we may be mid-tap)
+    size_t arenaMark = tagArenaUsed;
+    TagJsonDocument json(slot->length * 2);
+    if (deserializeJson(json, (const char *)&eventPool[slot->offset]))
+    {
+      // can't rebuild it (no arena left), drop it rather than stall the queue
+      tagArenaUsed = arenaMark;
+      slot->acked = true;
+      eventsDropped++;
+      continue;
+    }
+
+    bool published = mqttPublishStatus(json.as<JsonVariant>());
+    tagArenaUsed = arenaMark;
+
+    if (!published)
+      break;
+
+    if (slot->attempts++ > 0) { eventsRetransmitted++; }
+    slot->sent = true;
+    slot->sentMs = millis();
+    inFlight++;
+
+    // nothing to wait for if acks are disabled
+    if (ackWindow == 0) { slot->acked = true; }
+  }
+
+  eventQueuePopAcked();
+}
+
+bool publishEvent(JsonVariant json)
+{
+  json["seq"] = ++eventSeq;
+
+  // anything unsent has to go first to keep events in order
+  bool send = !eventQueueUnsent() && (ackWindow == 0 ? eventQueueCount == 0 : eventQueueInFlight() < ackWindow);
+  bool sent = send && mqttPublishStatus(json);
+
+  // without acks a sent event is done with, otherwise it waits in the window
+  if (!sent || ackWindow > 0)
+  {
+    eventQueuePush(json, sent);
+  }
+
+  return sent;
+}
+
+/*--------------------------- Tag Cache -------------------------------*/
+TagCacheEntry * tagCacheFind(byte uid[], uint8_t uidLength)
+{
+  for (uint8_t i = 0; i < TAG_CACHE_SIZE; i++)
+  {
+    if (tagCache[i].uidLength == uidLength && memcmp(tagCache[i].uid, uid, uidLength) == 0)
+      return &tagCache[i];
+  }
+
+  return NULL;
+}
+
+TagCacheEntry * tagCacheUpdate(byte uid[], uint8_t uidLength, uint32_t digest, bool digestValid)
+{
+  TagCacheEntry * entry = tagCacheFind(uid, uidLength);
+
+  // not cached, so take an empty slot or evict the least recently seen
+  if (!entry)
+  {
+    entry = &tagCache[0];
+    for (uint8_t i = 0; i < TAG_CACHE_SIZE; i++)
+    {
+      if (tagCache[i].uidLength == 0)
+      {
+        entry = &tagCache[i];
+        break;
+      }
+
+      if ((millis() - tagCache[i].lastSeenMs) > (millis() - entry->lastSeenMs))
+      {
+        entry = &tagCache[i];
+      }
+    }
+
+    memcpy(entry->uid, uid, uidLength);
+    entry->uidLength = uidLength;
+    entry->recordCount = 0;
+    entry->recordDigestValid = 0;
+  }
+
+  entry->digest = digest;
+  entry->digestValid = digestValid;
+  entry->lastSeenMs = millis();
+  return entry;
+}
+
+/*--------------------------- Pipeline Phases -------------------------*/
+void phaseEnd()
+{
+  if (currentPhase >= PHASE_COUNT)
+    return;
+
+  spanEnd(currentPhase);
+
+#ifdef BENCHMARK
+  uint32_t elapsedUs = micros() - phaseStartUs;
+  PhaseTiming * timing = &phaseTimings[currentPhase];
+  timing->count++;
+  timing->totalUs += elapsedUs;
+  if (elapsedUs > timing->maxUs) { timing->maxUs = elapsedUs; }
+#endif
+
+#if defined(OXRS_ESP8266)
+  // free space is the painted region the phase never touched
+  uint32_t used = LOOP_STACK_BYTES - ESP.getFreeContStack();
+#else
+  // FreeRTOS only tracks a task-lifetime high-water mark
+  uint32_t used = LOOP_STACK_BYTES - uxTaskGetStackHighWaterMark(NULL);
+#endif
+
+  if (used > stackHighWater[currentPhase])
+  {
+    stackHighWater[currentPhase] = used;
+
+    if (used > STACK_WARN_BYTES)
+    {
+      oxrs.print(F("[rfid] stack usage high during "));
+      oxrs.print(PHASE_NAMES[currentPhase]);
+      oxrs.print(F(" phase: "));
+      oxrs.println(used);
+    }
+  }
+
+  currentPhase = PHASE_COUNT;
+}
+
+void phaseBegin(uint8_t phase)
+{
+  phaseEnd();
+
+#if defined(OXRS_ESP8266)
+  // re-paint everything below the current stack pointer
+  ESP.resetFreeContStack();
+#endif
+
+  currentPhase = phase;
+  spanBegin(phase);
+
+#ifdef BENCHMARK
+  phaseStartUs = micros();
+#endif
+}
+
+/*--------------------------- Allocation Tracker ----------------------*/
+#ifdef ALLOC_TRACKER
+// Hooked via -Wl,--wrap so every heap allocation made from loop() is
+// recorded against its call site (see the d1mini-alloctrack env)
+struct AllocSite
+{
+  void * caller;
+  uint32_t count;
+  uint32_t bytes;
+};
+
+AllocSite allocSites[ALLOC_TRACKER_SITES];
+uint32_t allocCount = 0L;
+uint32_t allocBytes = 0L;
+uint32_t allocUntracked = 0L;
+volatile bool allocTrackerArmed = false;
+
+// Set while inside operator new/new[], whose own malloc() is not a new site
+volatile bool allocTrackerInside = false;
+
+void allocTrackerRecord(void * caller, size_t size)
+{
+  allocCount++;
+  allocBytes += size;
+
+#ifdef ALLOC_TRACKER_STRICT
+  // steady state must not allocate at all
+  abort();
+#endif
+
+  for (uint8_t i = 0; i < ALLOC_TRACKER_SITES; i++)
+  {
+    if (allocSites[i].caller == caller || allocSites[i].caller == NULL)
+    {
+      allocSites[i].caller = caller;
+      allocSites[i].count++;
+      allocSites[i].bytes += size;
+      return;
+    }
+  }
+
+  // table full, only the totals are kept
+  allocUntracked++;
+}
+
+extern "C" void * __real_malloc(size_t size);
+extern "C" void * __real_calloc(size_t count, size_t size);
+extern "C" void * __real_realloc(void * ptr, size_t size);
+extern "C" void * __real__Znwj(size_t size);
+extern "C" void * __real__Znaj(size_t size);
+
+extern "C" void * __wrap_malloc(size_t size)
+{
+  if (allocTrackerArmed && !allocTrackerInside) { allocTrackerRecord(__builtin_return_address(0), size); }
+  return __real_malloc(size);
+}
+
+extern "C" void * __wrap_calloc(size_t count, size_t size)
+{
+  if (allocTrackerArmed && !allocTrackerInside) { allocTrackerRecord(__builtin_return_address(0), count * size); }
+  return __real_calloc(count, size);
+}
+
+extern "C" void * __wrap_realloc(void * ptr, size_t size)
+{
+  if (allocTrackerArmed && !allocTrackerInside) { allocTrackerRecord(__builtin_return_address(0), size); }
+  return __real_realloc(ptr, size);
+}
+
+extern "C" void * __wrap__Znwj(size_t size)
+{
+  // count the new itself, not the allocations it makes underneath
+  bool outer = allocTrackerArmed && !allocTrackerInside;
+  if (outer)
+  {
+    allocTrackerRecord(__builtin_return_address(0), size);
+    allocTrackerInside = true;
+  }
+
+  void * ptr = __real__Znwj(size);
+
+  if (outer) { allocTrackerInside = false; }
+  return ptr;
+}
+
+extern "C" void * __wrap__Znaj(size_t size)
+{
+  // count the new itself, not the allocations it makes underneath
+  bool outer = allocTrackerArmed && !allocTrackerInside;
+  if (outer)
+  {
+    allocTrackerRecord(__builtin_return_address(0), size);
+    allocTrackerInside = true;
+  }
+
+  void * ptr = __real__Znaj(size);
+
+  if (outer) { allocTrackerInside = false; }
+  return ptr;
+}
+#endif
+
+/*--------------------------- Program ---------------------------------*/
+char * toHexString(char buffer[], byte data[], uint16_t len)
+{
+  for (uint16_t i = 0; i < len; i++)
+  {
+    byte nib1 = (data[i] >> 4) & 0x0F;
+    byte nib2 = (data[i] >> 0) & 0x0F;
+
+    buffer[i*2+0] = nib1  < 0xA ? '0' + nib1  : 'A' + nib1 - 0xA;
+    buffer[i*2+1] = nib2  < 0xA ? '0' + nib2  : 'A' + nib2 - 0xA;
+  }
+
+  buffer[len*2] = '\0';
+  return buffer;
+}
+
+uint8_t fromHexString(byte buffer[], const char * hex, uint8_t maxLen)
+{
+  uint8_t len = 0;
+  while (len < maxLen && isxdigit(hex[len*2]) && isxdigit(hex[len*2+1]))
+  {
+    char pair[3] = { hex[len*2], hex[len*2+1], '\0' };
+    buffer[len++] = strtoul(pair, NULL, 16);
+  }
+  return len;
+}
+
+char * toAsciiString(char buffer[], byte data[], uint16_t len)
+{
+  for (uint16_t i = 0; i < len; i++)
+  {
+    if (data[i] <= 0x1F) 
+    {
+      buffer[i] = '.';
+    } 
+    else 
+    {
+      buffer[i] = (char)data[i];
+    }
+  }
+
+  buffer[len] = '\0';
+  return buffer;
+}
+
+uint32_t crc32(uint32_t crc, byte data[], uint16_t len)
+{
+  crc = ~crc;
+  for (uint16_t i = 0; i < len; i++)
+  {
+    crc = CRC32_TABLE[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = CRC32_TABLE[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+bool ndefDigest(NdefMessage * message, uint32_t * digest)
+{
+  // digest over the raw encoded NDEF bytes
+  uint16_t length = message->getEncodedSize();
+  byte * encoded = (byte *)tagArenaAlloc(length);
+  if (!encoded)
+    return false;
+
+  message->encode(encoded);
+  *digest = crc32(0L, encoded, length);
+  return true;
+}
+
+bool ndefRecordDigest(NdefRecord * record, byte payload[], uint16_t len, uint32_t * digest)
+{
+  // records are compared on their TNF, type, id and payload
+  byte tnf = record->getTnf();
+  uint32_t crc = crc32(0L, &tnf, 1);
+
+  uint8_t typeLength = record->getTypeLength();
+  uint8_t idLength = record->getIdLength();
+  byte * field = (byte *)tagArenaAlloc(max(typeLength, idLength));
+  if (!field && (typeLength > 0 || idLength > 0))
+    return false;
+
+  // lengths go in too, so bytes can't move between type and id unnoticed
+  record->getType(field);
+  crc = crc32(crc, &typeLength, 1);
+  crc = crc32(crc, field, typeLength);
+
+  record->getId(field);
+  crc = crc32(crc, &idLength, 1);
+  crc = crc32(crc, field, idLength);
+
+  *digest = crc32(crc, payload, len);
+  return true;
+}
+
+bool decodeUriRecord(JsonObject json, byte payload[], uint16_t len)
+{
+  if (len < 1 || payload[0] >= URI_PREFIX_COUNT)
+    return false;
+
+  // no prefix means the rest of the payload is the URI as-is
+  const char * prefix = URI_PREFIXES[payload[0]];
+  if (prefix[0] == '\0')
+  {
+    json["uri"] = (const char *)&payload[1];
+    return true;
+  }
+
+  uint8_t prefixLength = strlen(prefix);
+  char * uri = (char *)tagArenaAlloc(prefixLength + len);
+  if (!uri)
+    return false;
+
+  memcpy(uri, prefix, prefixLength);
+  memcpy(&uri[prefixLength], &payload[1], len - 1);
+  uri[prefixLength + len - 1] = '\0';
+
+  json["uri"] = (const char *)uri;
+  return true;
+}
+
+bool decodeTextRecord(JsonObject json, byte payload[], uint16_t len)
+{
+  if (len < 1)
+    return false;
+
+  // status byte: bit 7 = UTF-16 (not decoded), bits 0-5 = language length
+  byte status = payload[0];
+  uint8_t langLength = status & 0x3F;
+  if ((status & 0x80) || (1 + langLength > len))
+    return false;
+
+  // shuffle the language code down over the status byte so it can be
+  // terminated in place, the text already ends at the payload terminator
+  memmove(&payload[0], &payload[1], langLength);
+  payload[langLength] = '\0';
+
+  json["lang"] = (const char *)&payload[0];
+  json["text"] = (const char *)&payload[1 + langLength];
+  return true;
+}
+
+bool decodeRecord(JsonObject json, NdefRecord * record, byte payload[], uint16_t len)
+{
+  // only single character well-known types are decoded
+  if (record->getTnf() != TNF_WELL_KNOWN || record->getTypeLength() != 1)
+    return false;
+
+  byte type;
+  record->getType(&type);
+
+  switch (type)
+  {
+    case 'U':
+      return decodeUriRecord(json, payload, len);
+    case 'T':
+      return decodeTextRecord(json, payload, len);
+  }
+
+  return false;
+}
+
+void publishTag(NfcTag * tag)
+{
+  // get the tag UID
+  byte uid[MAX_UID_BYTES];
+  uint8_t uidLength = tag->getUidLength();
+  tag->getUid(uid, uidLength);
+
+  // parse the message (if any) and digest its content
+  phaseBegin(PHASE_PARSE);
+  NdefMessage ndefMessage = tag->hasNdefMessage() ? tag->getNdefMessage() : NdefMessage();
+  uint32_t digest = 0L;
+  bool digestValid = ndefDigest(&ndefMessage, &digest);
+
+  // has this tag been seen before with the same content? if we couldn't
+  // digest it (either time) we can't tell, so treat it as changed
+  TagCacheEntry * cached = tagCacheFind(uid, uidLength);
+  bool unchanged = cached && cached->digestValid && digestValid && cached->digest == digest;
+  uint8_t cachedRecordCount = cached ? cached->recordCount : 0;
+
+  // changed content on a known tag can be published as a record delta
+  bool delta = publishRecordDeltas && cached && !unchanged;
+
+  TagCacheEntry * entry = tagCacheUpdate(uid, uidLength, digest, digestValid);
+
+  // build the JSON payload with the tag details
+  phaseBegin(PHASE_SERIALIZE);
+  TagJsonDocument json(4096);
+  char buffer[MAX_UID_BYTES * 2 + 1];
+
+  json["uid"] = toHexString(buffer, uid, uidLength);
+
+  if (digestValid)
+  {
+    sprintf(buffer, "%08X", digest);
+    json["digest"] = buffer;
+  }
+
+  // unchanged content is only worth the uid and digest if configured
+  if (publishOnChange && unchanged)
+  {
+    json["unchanged"] = true;
+  }
+  else
+  {
+    json["type"] = tag->getTagType();
+  }
+
+  // does this tag have a message we need to publish?
+  uint8_t recordCount = ndefMessage.getRecordCount();
+  if ((tag->hasNdefMessage() || delta) && !(publishOnChange && unchanged))
+  {
+    JsonArray recordsJson = json.createNestedArray(delta ? "changes" : "records");
+    for (uint8_t i = 0; i < recordCount; i++)
+    {
+      NdefRecord ndefRecord = ndefMessage.getRecord(i);
+
+      // payload comes from the arena, not the stack, and is terminated so
+      // decoded strings can reference it directly until the arena is reset
+      int payloadLength = ndefRecord.getPayloadLength();
+      byte * payload = (byte *)tagArenaAlloc(payloadLength + 1);
+      if (!payload)
+      {
+        // forget this record's digest so the next read reports it changed
+        if (i < MAX_CACHED_RECORDS) { entry->recordDigestValid &= ~(1 << i); }
+        oxrs.println(F("[rfid] tag arena exhausted, record skipped"));
+        continue;
+      }
+      ndefRecord.getPayload(payload);
+      payload[payloadLength] = '\0';
+
+      // compare against the digest of this record from the last read
+      uint32_t recordDigest = 0L;
+      bool recordDigestValid = ndefRecordDigest(&ndefRecord, payload, payloadLength, &recordDigest);
+      bool recordChanged = i >= cachedRecordCount || i >= MAX_CACHED_RECORDS || !recordDigestValid ||
+                           !(entry->recordDigestValid & (1 << i)) || entry->recordDigest[i] != recordDigest;
+      if (i < MAX_CACHED_RECORDS)
+      {
+        entry->recordDigest[i] = recordDigest;
+        if (recordDigestValid) { entry->recordDigestValid |= (1 << i); } else { entry->recordDigestValid &= ~(1 << i); }
+      }
+
+      if (delta && !recordChanged)
+        continue;
+
+      JsonObject recordJson = recordsJson.createNestedObject();
+      if (delta)
+      {
+        recordJson["index"] = i;
+        recordJson["change"] = i < cachedRecordCount ? "changed" : "added";
+      }
+
+      recordJson["tnf"] = ndefRecord.getTnf();
+      recordJson["type"] = ndefRecord.getType();
+      recordJson["id"] = ndefRecord.getId();
+      recordJson["bytes"] = ndefRecord.getEncodedSize();
+
+      // well-known URI and text records are published decoded
+      if (decodeRecord(recordJson, &ndefRecord, payload, payloadLength))
+        continue;
+
+      char * payloadBuffer = (char *)tagArenaAlloc(payloadLength * 2 + 1);
+      if (!payloadBuffer)
+      {
+        oxrs.println(F("[rfid] tag arena exhausted, payload skipped"));
+        continue;
+      }
+
+      JsonObject payloadJson = recordJson.createNestedObject("payload");
+      payloadJson["hex"] = toHexString(payloadBuffer, payload, payloadLength);
+      payloadJson["ascii"] = toAsciiString(payloadBuffer, payload, payloadLength);
+    }
+
+    // anything beyond the new record count has been removed
+    for (uint8_t i = recordCount; delta && i < cachedRecordCount; i++)
+    {
+      JsonObject recordJson = recordsJson.createNestedObject();
+      recordJson["index"] = i;
+      recordJson["change"] = "removed";
+    }
+  }
+
+  entry->recordCount = recordCount;
+
+  // publish the tag details
+  phaseBegin(PHASE_PUBLISH);
+  publishEvent(json.as<JsonVariant>());
+  phaseEnd();
+}
+
+bool filterTag(byte uid[], uint8_t uidLength, uint8_t cardType)
+{
+  for (uint8_t i = 0; i < filterRuleCount; i++)
+  {
+    FilterRule * rule = &filterRules[i];
+
+    if (rule->cardType >= 0 && rule->cardType != cardType)
+      continue;
+
+    if (rule->uidLength > 0 && rule->uidLength != uidLength)
+      continue;
+
+    if (rule->prefixLength > uidLength)
+      continue;
+
+    bool match = true;
+    for (uint8_t j = 0; j < rule->prefixLength; j++)
+    {
+      if ((uid[j] & rule->mask[j]) != (rule->prefix[j] & rule->mask[j]))
+      {
+        match = false;
+        break;
+      }
+    }
+
+    if (match)
+      return rule->allow;
+  }
+
+  return filterDefaultAllow;
+}
+
+#ifdef USE_PN532_NFC
+bool pn532Detect(byte uid[], uint8_t * uidLength, uint8_t * cardType, uint16_t timeoutMs)
+{
+  return pn532ListTarget(pn532If, uid, uidLength, cardType, timeoutMs);
+}
+
+bool pn532ReadType2(byte uid[], uint8_t uidLength, NfcTag * tag)
+{
+  // the same tag back within the window carries on where it left off
+  bool resume = resumeUidLength == uidLength && memcmp(resumeUid, uid, uidLength) == 0 && 
+                (millis() - resumeLastMs) < RESUME_WINDOW_MS;
+
+  if (resume && resumePagesRead > 0)
+  {
+    readsResumed++;
+  }
+  else
+  {
+    // the capability container gives the size of the data area
+    byte cc[4];
+    if (!pn532.mifareultralight_ReadPage(3, cc))
+      return false;
+
+    memcpy(resumeUid, uid, uidLength);
+    resumeUidLength = uidLength;
+    resumePagesRead = 0;
+    resumePagesTotal = min((uint16_t)(cc[2] * 8), (uint16_t)TAG_DATA_BYTES) / 4;
+  }
+
+  uint16_t ndefStart = 0;
+  uint16_t ndefLength = 0;
+  int8_t found = 0;
+
+  while (resumePagesRead < resumePagesTotal)
+  {
+    if (!pn532.mifareultralight_ReadPage(TYPE2_FIRST_DATA_PAGE + resumePagesRead, &tagData[resumePagesRead * 4]))
+    {
+      // tag has gone, keep what we have for a little while
+      resumeLastMs = millis();
+      readsInterrupted++;
+      return false;
+    }
+    resumePagesRead++;
+
+    // only read as far as the end of the NDEF message
+    if (found == 0)
+    {
+      found = findNdefTlv(tagData, resumePagesRead * 4, &ndefStart, &ndefLength);
+      if (found != 0)
+      {
+        uint16_t pagesNeeded = found > 0 ? (ndefStart + ndefLength + 3) / 4 : resumePagesRead;
+        resumePagesTotal = min(resumePagesTotal, pagesNeeded);
+      }
+    }
+  }
+
+  // complete, nothing left to resume
+  resumeUidLength = 0;
+
+  if (found > 0 && ndefStart + ndefLength <= resumePagesTotal * 4)
+  {
+    *tag = NfcTag(uid, uidLength, TAG_TYPE_TYPE2, &tagData[ndefStart], ndefLength);
+  }
+  else
+  {
+    *tag = NfcTag(uid, uidLength, TAG_TYPE_TYPE2);
+  }
+  return true;
+}
+
+bool pn532Read(byte uid[], uint8_t uidLength, uint8_t cardType, NfcTag * tag)
+{
+  switch (cardType)
+  {
+    case CARD_CLASSIC:
+    {
+      MifareClassic mifareClassic = MifareClassic(pn532);
+      *tag = mifareClassic.read(uid, uidLength);
+      return true;
+    }
+
+    case CARD_TYPE2:
+      return pn532ReadType2(uid, uidLength, tag);
+  }
+
+  // no NDEF support for anything else, just the UID
+  *tag = NfcTag(uid, uidLength, CARD_TYPE_NAMES[cardType]);
+  return true;
+}
+
+bool pn532RFConfiguration(uint8_t item, const uint8_t data[], uint8_t len)
+{
+  uint8_t header[2] = { PN532_COMMAND_RFCONFIGURATION, item };
+  if (pn532If.writeCommand(header, sizeof(header), data, len) != 0)
+    return false;
+
+  // no response data, just the ack/status
+  uint8_t response[1];
+  return pn532If.readResponse(response, sizeof(response)) >= 0;
+}
+
+bool pn532ApplyRFConfig()
+{
+  // RxGain lives in bits 4-6 of CIU_RFCfg
+  uint8_t analog[sizeof(RF_ANALOG_106A)];
+  memcpy(analog, RF_ANALOG_106A, sizeof(analog));
+  analog[0] = (analog[0] & 0x8F) | ((rfRxGain & 0x07) << 4);
+
+  // the library sets MxRtyPassiveActivation for us, the analog settings
+  // have no library call so go straight to the interface
+  return pn532.setPassiveActivationRetries(rfMaxRetries) &&
+         pn532RFConfiguration(0x0A, analog, sizeof(analog));
+}
+
+uint8_t pn532Scan(ScannedTag tags[], uint8_t maxTags, uint16_t timeoutMs)
+{
+  uint8_t count = pn532ListTargets(pn532If, tags, maxTags, timeoutMs);
+
+  // cycle the field so halted tags are woken for the next detect or scan
+  uint8_t fieldOff[1] = { 0x00 };
+  uint8_t fieldOn[1] = { 0x01 };
+  pn532RFConfiguration(0x01, fieldOff, sizeof(fieldOff));
+  delay(5);
+  pn532RFConfiguration(0x01, fieldOn, sizeof(fieldOn));
+
+  return count;
+}
+
+bool pn532Begin()
+{
+  pn532.begin();
+
+  uint32_t version = pn532.getFirmwareVersion();
+  if (!version)
+    return false;
+
+  oxrs.print(F("[rfid] found PN5"));
+  oxrs.print((version >> 24) & 0xFF, HEX);
+  oxrs.print(F(" firmware v"));
+  oxrs.print((version >> 16) & 0xFF);
+  oxrs.print('.');
+  oxrs.println((version >> 8) & 0xFF);
+
+  // Configure to read tags
+  pn532.SAMConfig();
+
+  // Apply our RF settings
+  return pn532ApplyRFConfig();
+}
+
+class PN532Backend : public ReaderBackend
+{
+  public:
+    const char * name() { return "PN532"; }
+    uint8_t capabilities() { return READER_CAP_NDEF | READER_CAP_RF_TUNING | READER_CAP_DETECT_TIMEOUT | READER_CAP_INVENTORY; }
+    bool begin() { return pn532Begin(); }
+    bool detect(byte uid[], uint8_t * uidLength, uint8_t * cardType, uint16_t timeoutMs) { return pn532Detect(uid, uidLength, cardType, timeoutMs); }
+    uint8_t scan(ScannedTag tags[], uint8_t maxTags, uint16_t timeoutMs) { return pn532Scan(tags, maxTags, timeoutMs); }
+    bool read(byte uid[], uint8_t uidLength, uint8_t cardType, NfcTag * tag) { return pn532Read(uid, uidLength, cardType, tag); }
+    bool applyRFConfig() { return pn532ApplyRFConfig(); }
+};
+
+PN532Backend readerBackend;
+#endif
+
+#ifdef USE_RC522_NFC
+// RC522, cheap UID-only reader for doors
+class RC522Backend : public ReaderBackend
+{
+  public:
+    const char * name() { return "RC522"; }
+    uint8_t capabilities() { return READER_CAP_INVENTORY; }
+
+    bool begin()
+    {
+      mfrc522.PCD_Init();
+
+      byte version = mfrc522.PCD_ReadRegister(MFRC522::VersionReg);
+      if (version == 0x00 || version == 0xFF)
+        return false;
+
+      oxrs.print(F("[rfid] found RC522 firmware 0x"));
+      oxrs.println(version, HEX);
+      return true;
+    }
+
+    bool detect(byte uid[], uint8_t * uidLength, uint8_t * cardType, uint16_t timeoutMs)
+    {
+      // wake (rather than request) so a card left on the reader is still seen
+      byte atqa[2];
+      byte atqaSize = sizeof(atqa);
+      MFRC522::StatusCode status = mfrc522.PICC_WakeupA(atqa, &atqaSize);
+      if (status != MFRC522::STATUS_OK && status != MFRC522::STATUS_COLLISION)
+        return false;
+
+      if (mfrc522.PICC_Select(&mfrc522.uid) != MFRC522::STATUS_OK)
+        return false;
+
+      mfrc522.PICC_HaltA();
+
+      *uidLength = min(mfrc522.uid.size, (byte)MAX_UID_BYTES);
+      *cardType = getCardType(mfrc522.uid.sak);
+      memcpy(uid, mfrc522.uid.uidByte, *uidLength);
+      return true;
+    }
+
+    uint8_t scan(ScannedTag tags[], uint8_t maxTags, uint16_t timeoutMs)
+    {
+      uint8_t count = 0;
+
+      // request (rather than wake) so tags already halted stay quiet, and
+      // anticollision in select picks one of the rest each time round
+      while (count < maxTags)
+      {
+        byte atqa[2];
+        byte atqaSize = sizeof(atqa);
+        MFRC522::StatusCode status = mfrc522.PICC_RequestA(atqa, &atqaSize);
+        if (status != MFRC522::STATUS_OK && status != MFRC522::STATUS_COLLISION)
+          break;
+
+        if (mfrc522.PICC_Select(&mfrc522.uid) != MFRC522::STATUS_OK)
+          break;
+
+        mfrc522.PICC_HaltA();
+
+        if (!scanAdd(tags, &count, maxTags, mfrc522.uid.uidByte, mfrc522.uid.size, getCardType(mfrc522.uid.sak)))
+          break;
+      }
+
+      // cycle the field so halted tags are woken for the next detect or scan
+      mfrc522.PCD_AntennaOff();
+      delay(5);
+      mfrc522.PCD_AntennaOn();
+
+      return count;
+    }
+};
+
+RC522Backend readerBackend;
+#endif
+
+#ifdef USE_PN5180_NFC
+// PN5180, ISO15693 (NFC Forum Type 5) long range tags
+class PN5180Backend : public ReaderBackend
+{
+  public:
+    const char * name() { return "PN5180"; }
+    uint8_t capabilities() { return READER_CAP_NDEF | READER_CAP_INVENTORY; }
+
+    bool begin()
+    {
+      pn5180.begin();
+      pn5180.reset();
+
+      uint8_t version[2];
+      pn5180.readEEprom(PRODUCT_VERSION, version, sizeof(version));
+      if (version[1] == 0xFF)
+        return false;
+
+      oxrs.print(F("[rfid] found PN5180 product v"));
+      oxrs.print(version[1]);
+      oxrs.print('.');
+      oxrs.println(version[0]);
+
+      pn5180.setupRF();
+      return true;
+    }
+
+    bool detect(byte uid[], uint8_t * uidLength, uint8_t * cardType, uint16_t timeoutMs)
+    {
+      // a single slot inventory, the library has its own fixed timeouts
+      if (pn5180.getInventory(uid) != ISO15693_EC_OK)
+        return false;
+
+      *uidLength = 8;
+      *cardType = CARD_ISO15693;
+      return true;
+    }
+
+    uint8_t scan(ScannedTag tags[], uint8_t maxTags, uint16_t timeoutMs)
+    {
+      uint8_t count = 0;
+      scanSlots(tags, &count, maxTags, 0, 0);
+      return count;
+    }
+
+    bool read(byte uid[], uint8_t uidLength, uint8_t cardType, NfcTag * tag)
+    {
+      uint8_t blockSize, blockCount;
+      if (pn5180.getSystemInfo(uid, &blockSize, &blockCount) != ISO15693_EC_OK)
+        return false;
+
+      // tags that don't report a (sane) block size use the usual 4 bytes
+      if (blockSize == 0 || blockSize > 32) { blockSize = 4; }
+
+      uint16_t blocksMax = min((uint16_t)blockCount, (uint16_t)(TAG_DATA_BYTES / blockSize));
+
+      // the capability container comes first (4 bytes, or 8 when the data
+      // area is too big for byte 2), TLVs follow it, and we only read as
+      // far as the end of the NDEF message
+      uint16_t ccLength = 0;
+      uint16_t ndefStart = 0;
+      uint16_t ndefLength = 0;
+      int8_t found = 0;
+
+      uint16_t blocks = 0;
+      while (blocks < blocksMax)
+      {
+        if (pn5180.readSingleBlock(uid, blocks, &tagData[blocks * blockSize], blockSize) != ISO15693_EC_OK)
+          return false;
+        blocks++;
+
+        uint16_t bytes = blocks * blockSize;
+        if (ccLength == 0)
+        {
+          if (bytes < 4)
+            continue;
+
+          // not NDEF formatted, so just the UID
+          if (tagData[0] != 0xE1 && tagData[0] != 0xE2)
+            break;
+
+          ccLength = tagData[2] == 0 ? 8 : 4;
+        }
+
+        if (bytes <= ccLength)
+          continue;
+
+        found = findNdefTlv(&tagData[ccLength], bytes - ccLength, &ndefStart, &ndefLength);
+        if (found < 0 || (found > 0 && ccLength + ndefStart + ndefLength <= bytes))
+          break;
+      }
+
+      if (found > 0 && ccLength + ndefStart + ndefLength <= blocks * blockSize)
+      {
+        *tag = NfcTag(uid, uidLength, CARD_TYPE_NAMES[cardType], &tagData[ccLength + ndefStart], ndefLength);
+      }
+      else
+      {
+        *tag = NfcTag(uid, uidLength, CARD_TYPE_NAMES[cardType]);
+      }
+      return true;
+    }
+
+  private:
+    // 16 slot inventory (the library only does single slot), tags whose
+    // UID bits after the mask match the slot number answer in that slot and
+    // any slot with a collision is split again with a longer mask
+    void scanSlots(ScannedTag tags[], uint8_t * count, uint8_t maxTags, uint16_t mask, uint8_t maskLength)
+    {
+      // flags (high data rate, inventory, 16 slots), inventory, mask
+      uint8_t command[5] = { 0x06, 0x01, maskLength, (uint8_t)mask, (uint8_t)(mask >> 8) };
+      uint16_t collisions = 0;
+
+      // bare EOF frames need bits cleared in TX_CONFIG, put it back after
+      uint32_t txConfig;
+      pn5180.readRegister(TX_CONFIG, &txConfig);
+
+      pn5180.clearIRQStatus(0x000FFFFF);
+      pn5180.sendData(command, 3 + (maskLength + 7) / 8);
+
+      for (uint8_t slot = 0; slot < 16; slot++)
+      {
+        uint32_t startUs = micros();
+        while (!(pn5180.getIRQStatus() & RX_IRQ_STAT) && (micros() - startUs) < INVENTORY_SLOT_US) { yield(); }
+
+        uint32_t rxStatus = 0;
+        if (pn5180.getIRQStatus() & RX_IRQ_STAT) { pn5180.readRegister(RX_STATUS, &rxStatus); }
+
+        // collision, or overlapping answers that failed the CRC
+        uint16_t length = rxStatus & 0x1FF;
+        if (rxStatus & ((1UL << 18) | (1UL << 16)))
+        {
+          collisions |= 1 << slot;
+        }
+        else if (length >= 10)
+        {
+          // flags, DSFID, UID (8)
+          uint8_t * response = pn5180.readData(length);
+          if (response && !(response[0] & 0x01))
+          {
+            scanAdd(tags, count, maxTags, &response[2], 8, CARD_ISO15693);
+          }
+        }
+
+        if (slot == 15)
+          break;
+
+        // on to the next slot, sendData goes idle then back to transceive
+        pn5180.writeRegisterWithAndMask(TX_CONFIG, 0xFFFFFB3F);
+        pn5180.clearIRQStatus(0x000FFFFF);
+        pn5180.sendData(NULL, 0);
+      }
+
+      pn5180.writeRegister(TX_CONFIG, txConfig);
+
+      // two levels of splitting is already 256 slots
+      for (uint8_t slot = 0; slot < 16 && maskLength < 8 && *count < maxTags; slot++)
+      {
+        if (collisions & (1 << slot)) { scanSlots(tags, count, maxTags, mask | (slot << maskLength), maskLength + 4); }
+      }
+    }
+};
+
+PN5180Backend readerBackend;
+#endif
+
+ReaderBackend * reader = &readerBackend;
+
+bool readTag(byte uid[], uint8_t uidLength, uint8_t cardType, NfcTag * tag)
+{
+  // UID-only readers skip straight to publishing
+  if (!(reader->capabilities() & READER_CAP_NDEF))
+  {
+    *tag = NfcTag(uid, uidLength, CARD_TYPE_NAMES[cardType]);
+    return true;
+  }
+
+  return reader->read(uid, uidLength, cardType, tag);
+}
+
+void calibrateRF()
+{
+  if (!(reader->capabilities() & READER_CAP_RF_TUNING))
+  {
+    oxrs.print(F("[rfid] RF calibration not supported by "));
+    oxrs.println(reader->name());
+    return;
+  }
+
+  oxrs.println(F("[rfid] calibrating RF retries, keep a card on the reader..."));
+
+  TagJsonDocument json(2048);
+  JsonObject calibrationJson = json.createNestedObject("calibration");
+  JsonArray resultsJson = calibrationJson.createNestedArray("results");
+
+  byte uid[MAX_UID_BYTES];
+  uint8_t uidLength;
+  uint8_t cardType;
+
+  // pick the fastest setting that detected the card every time
+  uint8_t previousRetries = rfMaxRetries;
+  int chosen = -1;
+  uint32_t chosenUs = 0L;
+
+  for (uint8_t step = 0; step < CALIBRATION_STEPS; step++)
+  {
+    rfMaxRetries = CALIBRATION_RETRIES[step];
+    reader->applyRFConfig();
+
+    uint8_t hits = 0;
+    uint32_t totalUs = 0L;
+    for (uint8_t attempt = 0; attempt < CALIBRATION_ATTEMPTS; attempt++)
+    {
+      uint32_t startUs = micros();
+      if (reader->detect(uid, &uidLength, &cardType, MAX_DETECT_TIMEOUT_MS)) { hits++; }
+      totalUs += micros() - startUs;
+      yield();
+    }
+
+    uint32_t avgUs = totalUs / CALIBRATION_ATTEMPTS;
+
+    JsonObject resultJson = resultsJson.createNestedObject();
+    resultJson["retries"] = rfMaxRetries;
+    resultJson["hits"] = hits;
+    resultJson["avgUs"] = avgUs;
+
+    if (hits == CALIBRATION_ATTEMPTS && (chosen < 0 || avgUs < chosenUs))
+    {
+      chosen = rfMaxRetries;
+      chosenUs = avgUs;
+    }
+  }
+
+  // nothing was reliable (or no card), so go back to what we had before
+  rfMaxRetries = chosen < 0 ? previousRetries : chosen;
+  reader->applyRFConfig();
+
+  calibrationJson["success"] = chosen >= 0;
+  calibrationJson["rfMaxRetries"] = rfMaxRetries;
+  mqttPublishStatus(json.as<JsonVariant>());
+  tagArenaReset();
+
+  oxrs.print(F("[rfid] calibration complete, rfMaxRetries: "));
+  oxrs.println(rfMaxRetries);
+}
+
+Decision * decisionFind(byte uid[], uint8_t uidLength)
+{
+  for (uint8_t i = 0; i < DECISION_CACHE_SIZE; i++)
+  {
+    Decision * decision = &decisionCache[i];
+    if (decision->uidLength == uidLength && memcmp(decision->uid, uid, uidLength) == 0)
+      return decision;
+  }
+
+  return NULL;
+}
+
+void decisionStore(byte uid[], uint8_t uidLength, bool allow, uint32_t ttlSecs)
+{
+  Decision * decision = decisionFind(uid, uidLength);
+
+  // take an expired/empty slot, or evict the one closest to expiry
+  if (!decision)
+  {
+    decision = &decisionCache[0];
+    for (uint8_t i = 0; i < DECISION_CACHE_SIZE; i++)
+    {
+      Decision * candidate = &decisionCache[i];
+      if (candidate->uidLength == 0 || (millis() - candidate->storedMs) >= candidate->ttlMs)
+      {
+        decision = candidate;
+        break;
+      }
+
+      if ((candidate->ttlMs - (millis() - candidate->storedMs)) < (decision->ttlMs - (millis() - decision->storedMs)))
+      {
+        decision = candidate;
+      }
+    }
+
+    memcpy(decision->uid, uid, uidLength);
+    decision->uidLength = uidLength;
+  }
+
+  decision->allow = allow;
+  decision->storedMs = millis();
+  decision->ttlMs = min(ttlSecs, (uint32_t)MAX_DECISION_TTL_SECS) * 1000L;
+
+  // a reply to our last published tag tells us the round trip time
+  if (decisionPendingUidLength == uidLength && memcmp(decisionPendingUid, uid, uidLength) == 0)
+  {
+    uint32_t rttMs = millis() - decisionPendingMs;
+    decisionRttMs = decisionRttMs == 0 ? rttMs : (decisionRttMs * 7 + rttMs) / 8;
+    decisionPendingUidLength = 0;
+  }
+}
+
+void expireStaleState()
+{
+  // elapsed time comparisons only hold for less than one millis() wrap
+  // (~49 days), so forget anything expired before it can look fresh again
+  for (uint8_t i = 0; i < DECISION_CACHE_SIZE; i++)
+  {
+    Decision * decision = &decisionCache[i];
+    if (decision->uidLength > 0 && (millis() - decision->storedMs) >= decision->ttlMs)
+    {
+      decision->uidLength = 0;
+    }
+  }
+
+  if (resumeUidLength > 0 && (millis() - resumeLastMs) >= RESUME_WINDOW_MS)
+  {
+    resumeUidLength = 0;
+  }
+}
+
+void decideTag(byte uid[], uint8_t uidLength)
+{
+  // the tag will be published, so time how long the controller takes
+  memcpy(decisionPendingUid, uid, uidLength);
+  decisionPendingUidLength = uidLength;
+  decisionPendingMs = millis();
+
+  Decision * decision = decisionFind(uid, uidLength);
+  if (!decision || (millis() - decision->storedMs) >= decision->ttlMs)
+  {
+    decisionMisses++;
+    return;
+  }
+
+  // decide now, the full tag event that follows lets the controller revalidate
+  decisionHits++;
+  decisionSavedMs += decisionRttMs;
+
+  TagJsonDocument json(256);
+  JsonObject decisionJson = json.createNestedObject("decision");
+
+  char buffer[MAX_UID_BYTES * 2 + 1];
+  decisionJson["uid"] = toHexString(buffer, uid, uidLength);
+  decisionJson["allow"] = decision->allow;
+  decisionJson["cached"] = true;
+
+  publishEvent(json.as<JsonVariant>());
+  tagArenaReset();
+}
+
+void publishSerialEvent(uint8_t type, byte uid[], uint8_t uidLength, uint8_t cardType)
+{
+#ifdef SERIAL_EVENTS
+  // type, count (4), uptime ms (4), card type, uid length, uid, crc (2), little-endian
+  byte frame[11 + MAX_UID_BYTES + 2];
+  uint32_t count = ++serialEventCount;
+  uint32_t now = millis();
+
+  frame[0] = type;
+  memcpy(&frame[1], &count, 4);
+  memcpy(&frame[5], &now, 4);
+  frame[9] = cardType;
+  frame[10] = uidLength;
+  memcpy(&frame[11], uid, uidLength);
+
+  uint16_t len = 11 + uidLength;
+  uint16_t crc = crc16(frame, len);
+  frame[len++] = crc & 0xFF;
+  frame[len++] = crc >> 8;
+
+  byte encoded[sizeof(frame) + 2];
+  uint16_t encodedLength = cobsEncode(encoded, frame, len);
+
+  // delimit both ends so the host can resync after any debug text
+  Serial.write((uint8_t)0x00);
+  Serial.write(encoded, encodedLength);
+  Serial.write((uint8_t)0x00);
+#endif
+}
+
+void getPadState(JsonObject json)
+{
+  char buffer[MAX_UID_BYTES * 2 + 1];
+
+  if (padUidLength > 0)
+  {
+    json["uid"] = toHexString(buffer, padUid, padUidLength);
+    if (padDigestValid)
+    {
+      sprintf(buffer, "%08X", padDigest);
+      json["digest"] = buffer;
+    }
+  }
+  else
+  {
+    json["uid"] = (char *)0;
+  }
+
+  json["sinceMs"] = padSinceMs;
+}
+
+void publishPadState()
+{
+  TagJsonDocument json(256);
+  getPadState(json.createNestedObject("state"));
+  publishEvent(json.as<JsonVariant>());
+}
+
+/*--------------------------- Access Log ------------------------------*/
+AccessLogSegment * accessLogSegment(uint8_t index)
+{
+  return &accessLogSegments[(accessLogHead + index) % ACCESS_LOG_SEGMENTS];
+}
+
+char * accessLogPath(char buffer[], uint32_t id)
+{
+  sprintf(buffer, "%s/%lu", ACCESS_LOG_DIR, (unsigned long)id);
+  return buffer;
+}
+
+void accessLogIndex(AccessLogSegment * segment)
+{
+  char path[32];
+  File file = LittleFS.open(accessLogPath(path, segment->id), "r");
+  if (!file)
+  {
+    segment->records = 0;
+    return;
+  }
+
+  segment->records = min((uint32_t)(file.size() / sizeof(AccessLogRecord)), (uint32_t)ACCESS_LOG_SEGMENT_RECORDS);
+
+  // only the first record of each block is read, hence "sparse"
+  for (uint16_t block = 0; block * ACCESS_LOG_INDEX_EVERY < segment->records; block++)
+  {
+    AccessLogRecord record;
+    file.seek(block * ACCESS_LOG_INDEX_EVERY * sizeof(AccessLogRecord));
+    if (file.read((uint8_t *)&record, sizeof(record)) == sizeof(record))
+    {
+      uint32_t timeSecs = record.timeSecs;
+      accessLogMaxTime = max(accessLogMaxTime, timeSecs);
+    }
+    segment->keys[block] = accessLogMaxTime;
+  }
+
+  // the tail of the last block may hold later timestamps than its key
+  if (segment->records > 0)
+  {
+    AccessLogRecord record;
+    file.seek((segment->records - 1) * sizeof(AccessLogRecord));
+    if (file.read((uint8_t *)&record, sizeof(record)) == sizeof(record))
+    {
+      uint32_t timeSecs = record.timeSecs;
+      accessLogMaxTime = max(accessLogMaxTime, timeSecs);
+    }
+  }
+
+  file.close();
+}
+
+void accessLogBegin()
+{
+  if (!LittleFS.begin())
+  {
+    oxrs.println(F("[rfid] failed to mount filesystem, access log disabled"));
+    return;
+  }
+
+  LittleFS.mkdir(ACCESS_LOG_DIR);
+
+  // segment files are named by an increasing id, keep the newest
+  uint32_t ids[ACCESS_LOG_SEGMENTS];
+  uint8_t count = 0;
+
+  File dir = LittleFS.open(ACCESS_LOG_DIR, "r");
+  File file = dir.openNextFile();
+  while (file)
+  {
+    const char * name = strrchr(file.name(), '/');
+    uint32_t id = strtoul(name ? name + 1 : file.name(), NULL, 10);
+    file.close();
+
+    // insert in order, dropping the oldest once full
+    char path[32];
+    if (count == ACCESS_LOG_SEGMENTS && id < ids[0])
+    {
+      LittleFS.remove(accessLogPath(path, id));
+    }
+    else
+    {
+      if (count == ACCESS_LOG_SEGMENTS)
+      {
+        LittleFS.remove(accessLogPath(path, ids[0]));
+        memmove(&ids[0], &ids[1], --count * sizeof(uint32_t));
+      }
+
+      uint8_t i = count++;
+      while (i > 0 && ids[i - 1] > id) { ids[i] = ids[i - 1]; i--; }
+      ids[i] = id;
+    }
+
+    file = dir.openNextFile();
+  }
+  dir.close();
+
+  accessLogHead = 0;
+  accessLogSegmentCount = count;
+  accessLogMaxTime = 0L;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    AccessLogSegment * segment = accessLogSegment(i);
+    segment->id = ids[i];
+    accessLogIndex(segment);
+  }
+
+  accessLogMounted = true;
+}
+
+bool accessLogWrite(AccessLogRecord * record)
+{
+  // start a new segment when the newest is full, dropping the oldest
+  AccessLogSegment * segment = accessLogSegmentCount > 0 ? accessLogSegment(accessLogSegmentCount - 1) : NULL;
+  if (!segment || segment->records >= ACCESS_LOG_SEGMENT_RECORDS)
+  {
+    uint32_t id = segment ? segment->id + 1 : 0;
+
+    if (accessLogSegmentCount == ACCESS_LOG_SEGMENTS)
+    {
+      char path[32];
+      LittleFS.remove(accessLogPath(path, accessLogSegment(0)->id));
+      accessLogHead = (accessLogHead + 1) % ACCESS_LOG_SEGMENTS;
+      accessLogSegmentCount--;
+    }
+
+    segment = accessLogSegment(accessLogSegmentCount++);
+    segment->id = id;
+    segment->records = 0;
+  }
+
+  char path[32];
+  File file = LittleFS.open(accessLogPath(path, segment->id), "a");
+  if (!file || file.write((uint8_t *)record, sizeof(AccessLogRecord)) != sizeof(AccessLogRecord))
+  {
+    if (file) { file.close(); }
+    accessLogErrors++;
+    return false;
+  }
+  file.close();
+
+  uint32_t timeSecs = record->timeSecs;
+  accessLogMaxTime = max(accessLogMaxTime, timeSecs);
+  if (segment->records % ACCESS_LOG_INDEX_EVERY == 0)
+  {
+    segment->keys[segment->records / ACCESS_LOG_INDEX_EVERY] = accessLogMaxTime;
+  }
+  segment->records++;
+  return true;
+}
+
+void accessLogFlush()
+{
+  if (accessLogBuffered == 0)
+    return;
+
+  for (uint8_t i = 0; i < accessLogBuffered; i++)
+  {
+    uint32_t startUs = micros();
+    if (!accessLogWrite(&accessLogBuffer[i]))
+      continue;
+
+    uint32_t elapsedUs = micros() - startUs;
+    accessLogAppends++;
+    accessLogAppendTotalUs += elapsedUs;
+    if (elapsedUs > accessLogAppendMaxUs) { accessLogAppendMaxUs = elapsedUs; }
+  }
+
+  accessLogBuffered = 0;
+}
+
+void accessLogAppend(byte uid[], uint8_t uidLength, uint8_t cardType, uint8_t flags)
+{
+  if (!accessLogEnabled || !accessLogMounted)
+    return;
+
+  // the tap is published first, records are written out after (only a
+  // burst of taps in one poll makes us write here)
+  if (accessLogBuffered == ACCESS_LOG_BUFFER_RECORDS) { accessLogFlush(); }
+
+  // timestamps never go backwards (from what is written or still buffered),
+  // so the index stays sorted
+  uint32_t timeSecs = accessLogMaxTime;
+  for (uint8_t i = 0; i < accessLogBuffered; i++)
+  {
+    uint32_t bufferedSecs = accessLogBuffer[i].timeSecs;
+    timeSecs = max(timeSecs, bufferedSecs);
+  }
+
+  AccessLogRecord * record = &accessLogBuffer[accessLogBuffered++];
+  memset(record, 0, sizeof(AccessLogRecord));
+  time_t now = time(nullptr);
+  if (now >= TIME_VALID_SECS)
+  {
+    record->timeSecs = max(timeSecs, (uint32_t)now);
+  }
+  record->uptimeMs = millis();
+  memcpy(record->uid, uid, uidLength);
+  record->uidLength = uidLength;
+  record->cardType = cardType;
+  record->flags = flags;
+}
+
+uint32_t accessLogBlocks()
+{
+  if (accessLogSegmentCount == 0)
+    return 0;
+
+  uint16_t blocksPerSegment = ACCESS_LOG_SEGMENT_RECORDS / ACCESS_LOG_INDEX_EVERY;
+  uint16_t lastRecords = accessLogSegment(accessLogSegmentCount - 1)->records;
+  return (accessLogSegmentCount - 1) * blocksPerSegment + (lastRecords + ACCESS_LOG_INDEX_EVERY - 1) / ACCESS_LOG_INDEX_EVERY;
+}
+
+uint32_t accessLogBlockKey(uint32_t block)
+{
+  uint16_t blocksPerSegment = ACCESS_LOG_SEGMENT_RECORDS / ACCESS_LOG_INDEX_EVERY;
+  return accessLogSegment(block / blocksPerSegment)->keys[block % blocksPerSegment];
+}
+
+uint32_t accessLogSeek(uint32_t fromSecs)
+{
+  // last block whose key is before fromSecs, matches can't start earlier
+  uint32_t low = 0;
+  uint32_t high = accessLogBlocks();
+  while (low + 1 < high)
+  {
+    uint32_t mid = (low + high) / 2;
+    if (accessLogBlockKey(mid) < fromSecs)
+    {
+      low = mid;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+void getAccessLogStats(JsonObject json)
+{
+  uint32_t records = 0L;
+  for (uint8_t i = 0; i < accessLogSegmentCount; i++)
+  {
+    records += accessLogSegment(i)->records;
+  }
+
+  json["records"] = records;
+  json["segments"] = accessLogSegmentCount;
+  json["errors"] = accessLogErrors;
+  json["appendAvgUs"] = accessLogAppends ? accessLogAppendTotalUs / accessLogAppends : 0;
+  json["appendMaxUs"] = accessLogAppendMaxUs;
+  json["queries"] = accessLogQueries;
+  json["queryLastUs"] = accessLogQueryLastUs;
+  json["queryMaxUs"] = accessLogQueryMaxUs;
+  json["queryScanned"] = accessLogQueryScanned;
+}
+
+void logBenchmark(uint32_t records)
+{
+  oxrs.print(F("[rfid] benchmarking access log with "));
+  oxrs.print(records);
+  oxrs.println(F(" records..."));
+
+  // kept out of the log directory so it is never mistaken for a segment
+  const char * path = "/logbench";
+  LittleFS.remove(path);
+
+  AccessLogRecord record;
+  memset(&record, 0, sizeof(record));
+
+  // appends the same way as a tap, opening the file each time
+  uint32_t startUs = micros();
+  uint32_t written = 0L;
+  for (uint32_t i = 0; i < records; i++)
+  {
+    record.uptimeMs = i;
+    File file = LittleFS.open(path, "a");
+    if (!file) { break; }
+    written += file.write((uint8_t *)&record, sizeof(record)) == sizeof(record);
+    file.close();
+    yield();
+  }
+  uint32_t appendUs = micros() - startUs;
+
+  // a full scan, then random seeks like a query's first read
+  File file = LittleFS.open(path, "r");
+  startUs = micros();
+  uint32_t read = 0L;
+  while (file && file.read((uint8_t *)&record, sizeof(record)) == sizeof(record)) { read++; }
+  uint32_t scanUs = micros() - startUs;
+
+  startUs = micros();
+  for (uint8_t i = 0; file && written > 0 && i < LOG_BENCHMARK_SEEKS; i++)
+  {
+    file.seek((random(written)) * sizeof(AccessLogRecord));
+    file.read((uint8_t *)&record, sizeof(record));
+  }
+  uint32_t seekUs = micros() - startUs;
+  if (file) { file.close(); }
+
+  LittleFS.remove(path);
+
+  TagJsonDocument json(512);
+  JsonObject benchJson = json.createNestedObject("logBenchmark");
+  benchJson["records"] = written;
+  benchJson["appendAvgUs"] = written ? appendUs / written : 0;
+  benchJson["appendsPerSec"] = appendUs ? (uint32_t)((uint64_t)written * 1000000 / appendUs) : 0;
+  benchJson["scanRecordsPerSec"] = scanUs ? (uint32_t)((uint64_t)read * 1000000 / scanUs) : 0;
+  benchJson["seekAvgUs"] = seekUs / LOG_BENCHMARK_SEEKS;
+  mqttPublishStatus(json.as<JsonVariant>());
+  tagArenaReset();
+
+  oxrs.println(F("[rfid] access log benchmark complete"));
+}
+
+/*--------------------------- Inventory -------------------------------*/
+void inventorySeen(byte uid[], uint8_t uidLength)
+{
+  for (uint8_t i = 0; i < inventoryCount; i++)
+  {
+    InventoryEntry * entry = &inventory[i];
+    if (entry->uidLength == uidLength && memcmp(entry->uid, uid, uidLength) == 0)
+    {
+      entry->lastSeenMs = millis();
+      return;
+    }
+  }
+
+  if (inventoryCount == INVENTORY_SIZE)
+  {
+    inventoryOverflow++;
+    return;
+  }
+
+  InventoryEntry * entry = &inventory[inventoryCount++];
+  memcpy(entry->uid, uid, uidLength);
+  entry->uidLength = uidLength;
+  entry->lastSeenMs = millis();
+  entry->reported = false;
+}
+
+void inventoryScan()
+{
+  phaseBegin(PHASE_DETECT);
+  scannedCount = reader->scan(scannedTags, INVENTORY_SCAN_MAX, detectTuner.timeoutMs);
+  phaseEnd();
+
+  for (uint8_t i = 0; i < scannedCount; i++)
+  {
+    ScannedTag * tag = &scannedTags[i];
+    if (filterTag(tag->uid, tag->uidLength, tag->cardType))
+    {
+      inventorySeen(tag->uid, tag->uidLength);
+    }
+  }
+}
+
+void publishInventory()
+{
+  char buffer[MAX_UID_BYTES * 2 + 1];
+
+  // every Nth report is a full snapshot so consumers can (re)sync
+  bool snapshot = inventorySnapshotEvery <= 1 || (inventoryReports % inventorySnapshotEvery) == 0;
+  inventoryReports++;
+
+  TagJsonDocument json(2048);
+  JsonObject inventoryJson = json.createNestedObject("inventory");
+  inventoryJson["snapshot"] = snapshot;
+
+  JsonArray tags = snapshot ? inventoryJson.createNestedArray("tags") : JsonArray();
+  JsonArray added = snapshot ? JsonArray() : inventoryJson.createNestedArray("added");
+  JsonArray removed = snapshot ? JsonArray() : inventoryJson.createNestedArray("removed");
+
+  bool changed = false;
+  uint8_t i = 0;
+  while (i < inventoryCount)
+  {
+    InventoryEntry * entry = &inventory[i];
+    bool present = (millis() - entry->lastSeenMs) <= inventoryTimeoutMs;
+
+    if (!present)
+    {
+      if (entry->reported)
+      {
+        removed.add(toHexString(buffer, entry->uid, entry->uidLength));
+        changed = true;
+      }
+
+      // removal order doesn't matter, so fill the gap with the last entry
+      *entry = inventory[--inventoryCount];
+      continue;
+    }
+
+    if (!entry->reported)
+    {
+      added.add(toHexString(buffer, entry->uid, entry->uidLength));
+      entry->reported = true;
+      changed = true;
+    }
+
+    tags.add(toHexString(buffer, entry->uid, entry->uidLength));
+    i++;
+  }
+
+  // nothing to say, traffic scales with change
+  if (!snapshot && !changed)
+    return;
+
+  inventoryJson["count"] = inventoryCount;
+  publishEvent(json.as<JsonVariant>());
+}
+
+void getInventoryStats(JsonObject json)
+{
+  json["present"] = inventoryCount;
+  json["lastScan"] = scannedCount;
+  json["reports"] = inventoryReports;
+  json["overflow"] = inventoryOverflow;
+}
+
+/*--------------------------- Usage Aggregation -----------------------*/
+void usageRecord(byte uid[], uint8_t uidLength)
+{
+  usageTaps++;
+
+  UsageEntry * smallest = NULL;
+  for (uint8_t i = 0; i < usageCount; i++)
+  {
+    UsageEntry * entry = &usageTable[i];
+    if (entry->uidLength == uidLength && memcmp(entry->uid, uid, uidLength) == 0)
+    {
+      entry->count++;
+      entry->lastSeenMs = millis();
+      return;
+    }
+
+    if (!smallest || entry->count < smallest->count) { smallest = entry; }
+  }
+
+  UsageEntry * entry;
+  uint32_t count = 0;
+
+  if (usageCount < USAGE_TABLE_SIZE)
+  {
+    entry = &usageTable[usageCount++];
+  }
+  else
+  {
+    // full, so the new UID takes over the least counted entry and
+    // inherits its count as the possible overestimate
+    entry = smallest;
+    count = smallest->count;
+    usageEvicted++;
+  }
+
+  memcpy(entry->uid, uid, uidLength);
+  entry->uidLength = uidLength;
+  entry->count = count + 1;
+  entry->error = count;
+  entry->firstSeenMs = millis();
+  entry->lastSeenMs = entry->firstSeenMs;
+}
+
+void publishUsage()
+{
+  char buffer[MAX_UID_BYTES * 2 + 1];
+
+  TagJsonDocument json(4096);
+  JsonObject usage = json.createNestedObject("usage");
+  usage["periodMs"] = millis() - usagePeriodStartMs;
+  usage["taps"] = usageTaps;
+  usage["evicted"] = usageEvicted;
+
+  JsonArray uids = usage.createNestedArray("uids");
+  for (uint8_t i = 0; i < usageCount; i++)
+  {
+    UsageEntry * entry = &usageTable[i];
+
+    JsonObject uidJson = uids.createNestedObject();
+    uidJson["uid"] = toHexString(buffer, entry->uid, entry->uidLength);
+    uidJson["count"] = entry->count;
+    if (entry->error > 0) { uidJson["error"] = entry->error; }
+    uidJson["firstMs"] = entry->firstSeenMs;
+    uidJson["lastMs"] = entry->lastSeenMs;
+  }
+
+  // if the broker is down keep counting, the next summary covers both periods
+  if (!mqttPublishTelemetry(json.as<JsonVariant>()))
+    return;
+
+  usageCount = 0;
+  usageTaps = 0;
+  usageEvicted = 0;
+  usagePeriodStartMs = millis();
+}
+
+void processReader() 
+{
+  // if no tag present then ensure we are ready to read a new one
+  byte uid[MAX_UID_BYTES];
+  uint8_t uidLength;
+  uint8_t cardType;
+
+  // shelf readers that can see every tag at once just keep the inventory,
+  // there is no single tag to follow through the read pipeline
+  if (inventoryIntervalMs > 0 && (reader->capabilities() & READER_CAP_INVENTORY))
+  {
+    inventoryScan();
+    return;
+  }
+
+  phaseBegin(PHASE_DETECT);
+  uint32_t detectStartUs = micros();
+  bool detected = reader->detect(uid, &uidLength, &cardType, detectTuner.timeoutMs);
+  uint32_t detectElapsedUs = micros() - detectStartUs;
+  phaseEnd();
+
+  // empty polls aren't worth a place in the timeline
+  if (!detected) { spanDiscard(PHASE_DETECT); }
+
+  // adapt the timeout to how quickly tags actually respond, for readers
+  // that let us set one
+  if (reader->capabilities() & READER_CAP_DETECT_TIMEOUT)
+  {
+    tuneDetectTimeout(&detectTuner, presence.filtered, detected, detectElapsedUs, uid, uidLength);
+  }
+
+  // debounce detection so a tag at the edge of the field doesn't flicker
+  if (!filterPresence(&presence, detected))
+  {
+    // tag has left the reader
+    if (arrivalUidLength > 0)
+    {
+      publishSerialEvent(SERIAL_EVENT_TAG_REMOVED, arrivalUid, arrivalUidLength, 0);
+      arrivalUidLength = 0;
+    }
+
+    if (padUidLength > 0)
+    {
+      padUidLength = 0;
+      padSinceMs = millis();
+      if (usageIntervalMs == 0)
+      {
+        publishPadState();
+        tagArenaReset();
+      }
+    }
+
+    memset(lastUid, 0, MAX_UID_BYTES);
+    return;
+  }
+
+  // still considered present, but missed on this poll
+  if (!detected)
+    return;
+
+  // inventory tracks every allowed tag on every poll, not just arrivals
+  if (inventoryIntervalMs > 0 && filterTag(uid, uidLength, cardType))
+  {
+    inventorySeen(uid, uidLength);
+  }
+
+  // if the tag hasn't changed then nothing to do
+  if (memcmp(uid, lastUid, uidLength) == 0) 
+    return;
+
+  // reject unwanted cards before doing any NDEF work, ignoring them
+  // until they leave the reader
+  if (!filterTag(uid, uidLength, cardType))
+  {
+    memcpy(lastUid, uid, uidLength);
+    tagsRejected++;
+    accessLogAppend(uid, uidLength, cardType, ACCESS_LOG_REJECTED);
+
+    // a rejected card never counts as on the reader, so if it replaced
+    // one that did the reader is now empty
+    if (arrivalUidLength > 0)
+    {
+      publishSerialEvent(SERIAL_EVENT_TAG_REMOVED, arrivalUid, arrivalUidLength, 0);
+      arrivalUidLength = 0;
+    }
+
+    if (padUidLength > 0)
+    {
+      padUidLength = 0;
+      padSinceMs = millis();
+      if (usageIntervalMs == 0)
+      {
+        publishPadState();
+        tagArenaReset();
+      }
+    }
+    return;
+  }
+
+  // first poll of this arrival (an interrupted read retries on later polls),
+  // wired hosts hear about it before we spend any time reading it
+  bool arrival = arrivalUidLength != uidLength || memcmp(uid, arrivalUid, uidLength) != 0;
+  if (arrival)
+  {
+    // swapped for another tag without the reader ever seeing it empty
+    if (arrivalUidLength > 0)
+    {
+      publishSerialEvent(SERIAL_EVENT_TAG_REMOVED, arrivalUid, arrivalUidLength, 0);
+    }
+
+    memcpy(arrivalUid, uid, uidLength);
+    arrivalUidLength = uidLength;
+    publishSerialEvent(SERIAL_EVENT_TAG_ARRIVED, uid, uidLength, cardType);
+  }
+
+  // usage mode only counts arrivals, nothing per tap goes to the broker
+  if (usageIntervalMs > 0)
+  {
+    usageRecord(uid, uidLength);
+    accessLogAppend(uid, uidLength, cardType, 0);
+    memcpy(lastUid, uid, uidLength);
+
+    memcpy(padUid, uid, uidLength);
+    padUidLength = uidLength;
+    padSinceMs = millis();
+    padDigest = 0L;
+    padDigestValid = false;
+    return;
+  }
+
+  // repeat taps with a cached controller decision are decided right away,
+  // once per arrival
+  if (arrival) { decideTag(uid, uidLength); }
+
+  // read the tag details, if interrupted we try again (or resume) next poll
+  phaseBegin(PHASE_READ);
+  NfcTag tag;
+  bool read = readTag(uid, uidLength, cardType, &tag);
+  phaseEnd();
+
+  if (!read)
+    return;
+
+  // save the tag UID so we can ignore re-reads
+  tagsRead++;
+  memcpy(lastUid, uid, uidLength);
+  accessLogAppend(uid, uidLength, cardType, 0);
+
+  // publish the tag details
+  publishTag(&tag);
+  tagArenaReset();
+
+  // and the new state of the reader
+  memcpy(padUid, uid, uidLength);
+  padUidLength = uidLength;
+  padSinceMs = millis();
+  TagCacheEntry * cached = tagCacheFind(uid, padUidLength);
+  padDigestValid = cached && cached->digestValid;
+  padDigest = padDigestValid ? cached->digest : 0L;
+  publishPadState();
+
+  // release all per-tap temporaries
+  tagArenaReset();
+
+  // and keep the timeline if this tap was slow
+  spanFreezeIfSlow(detectStartUs);
+}
+
+void getHeapStats(JsonObject json)
+{
+  json["free"] = ESP.getFreeHeap();
+#if defined(OXRS_ESP32)
+  json["maxBlock"] = ESP.getMaxAllocHeap();
+#elif defined(OXRS_ESP8266)
+  json["maxBlock"] = ESP.getMaxFreeBlockSize();
+  json["fragmentation"] = ESP.getHeapFragmentation();
+#endif
+}
+
+void getDetectStats(JsonObject json)
+{
+  json["timeoutMs"] = detectTuner.timeoutMs;
+  json["percentileUs"] = detectTuner.percentileUs;
+  json["samples"] = detectTuner.sampleCount;
+  json["censored"] = detectTuner.censored;
+}
+
+void getDecisionStats(JsonObject json)
+{
+  json["hits"] = decisionHits;
+  json["misses"] = decisionMisses;
+  json["rttMs"] = decisionRttMs;
+  json["savedMs"] = decisionSavedMs;
+}
+
+void getEventStats(JsonObject json)
+{
+  json["seq"] = eventSeq;
+  json["queued"] = eventQueueCount;
+  json["inFlight"] = eventQueueInFlight();
+  json["retransmitted"] = eventsRetransmitted;
+  json["dropped"] = eventsDropped;
+}
+
+void getMqttStats(JsonObject json)
+{
+  json["failures"] = mqttFailures;
+  json["reconnects"] = mqttReconnects;
+  json["lastOutageMs"] = mqttLastOutageMs;
+  json["lastRecoveryMs"] = mqttLastRecoveryMs;
+}
+
+void mqttProbe()
+{
+  // small enough to not matter if it is the first thing through
+  TagJsonDocument json(256);
+  getMqttStats(json.createNestedObject("mqtt"));
+  mqttPublishTelemetry(json.as<JsonVariant>());
+  tagArenaReset();
+}
+
+void getReadStats(JsonObject json)
+{
+  json["reader"] = reader->name();
+
+  JsonArray capabilities = json.createNestedArray("capabilities");
+  for (uint8_t i = 0; i < READER_CAP_COUNT; i++)
+  {
+    if (reader->capabilities() & (1 << i)) { capabilities.add(READER_CAP_NAMES[i]); }
+  }
+
+  json["rejected"] = tagsRejected;
+  json["interrupted"] = readsInterrupted;
+  json["resumed"] = readsResumed;
+  json["read"] = tagsRead;
+}
+
+void getRFStats(JsonObject json)
+{
+  json["maxRetries"] = rfMaxRetries;
+  json["rxGain"] = rfRxGain;
+}
+
+void getPresenceStats(JsonObject json)
+{
+  json["flicker"] = presence.flicker;
+}
+
+void getStackStats(JsonObject json)
+{
+  json["limit"] = LOOP_STACK_BYTES;
+  for (uint8_t i = 0; i < PHASE_COUNT; i++)
+  {
+    json[PHASE_NAMES[i]] = stackHighWater[i];
+  }
+}
+
+#ifdef ALLOC_TRACKER
+void getAllocStats(JsonObject json)
+{
+  json["count"] = allocCount;
+  json["bytes"] = allocBytes;
+  json["untracked"] = allocUntracked;
+
+  char caller[11];
+  JsonArray sitesJson = json.createNestedArray("sites");
+  for (uint8_t i = 0; i < ALLOC_TRACKER_SITES; i++)
+  {
+    if (allocSites[i].caller == NULL)
+      break;
+
+    JsonObject siteJson = sitesJson.createNestedObject();
+    sprintf(caller, "0x%08X", (uint32_t)allocSites[i].caller);
+    siteJson["caller"] = caller;
+    siteJson["count"] = allocSites[i].count;
+    siteJson["bytes"] = allocSites[i].bytes;
+  }
+}
+#endif
+
+#ifdef VIRTUAL_CLOCK
+void soakViolation(uint8_t check, uint32_t value)
+{
+  // only the first of each kind is logged, the rest are counted
+  if (soakViolations[check]++ == 0)
+  {
+    oxrs.print(F("[rfid] soak invariant failed: "));
+    oxrs.print(SOAK_CHECK_NAMES[check]);
+    oxrs.print(F(" "));
+    oxrs.println(value);
+  }
+}
+
+void soakCheck(uint32_t loopStartUs, bool exempt)
+{
+  uint32_t now = millis();
+  if (now < soakLastMs) { soakWraps++; }
+  soakLastMs = now;
+
+  // per-tap temporaries must all have been released, a leak is left in
+  // place (so later taps feel it) and flagged each time it grows
+  if (tagArenaUsed > soakArenaFlagged)
+  {
+    soakViolation(SOAK_ARENA, tagArenaUsed);
+    soakArenaFlagged = tagArenaUsed;
+  }
+
+  // steady-state heap must not creep down (leaks, fragmentation), the
+  // baseline is taken once the broker is up and the first stats have gone
+  // out, so connection buffers are already allocated
+  uint32_t heapFree = ESP.getFreeHeap();
+  soakHeapMin = soakHeapMin == 0 ? heapFree : min(soakHeapMin, heapFree);
+  if (soakHeapBaseline == 0 && lastStatsMs != 0 && mqttEverUp && !mqttDown) { soakHeapBaseline = heapFree; }
+  if (soakHeapBaseline != 0 && heapFree + SOAK_HEAP_MARGIN_BYTES < soakHeapBaseline) { soakViolation(SOAK_HEAP, heapFree); }
+
+  // a loop must never stall, even across a wrap (calibration and
+  // benchmarks are slow by design)
+  uint32_t loopMs = (micros() - loopStartUs) / 1000;
+  if (!exempt)
+  {
+    soakLoopMaxMs = max(soakLoopMaxMs, loopMs);
+    if (loopMs > SOAK_MAX_LOOP_MS) { soakViolation(SOAK_LOOP, loopMs); }
+  }
+
+  // high-water marks only go up, so flag each new one once
+  for (uint8_t i = 0; i < PHASE_COUNT; i++)
+  {
+    if (stackHighWater[i] > STACK_WARN_BYTES && stackHighWater[i] > soakStackFlagged[i])
+    {
+      soakViolation(SOAK_STACK, stackHighWater[i]);
+      soakStackFlagged[i] = stackHighWater[i];
+    }
+  }
+
+  if (eventQueueCount > EVENT_QUEUE_SIZE) { soakViolation(SOAK_QUEUE, eventQueueCount); }
+}
+
+void getSoakStats(JsonObject json)
+{
+  json["clockMs"] = clockVirtualMs;
+  json["clockSpeed"] = clockSpeed;
+  json["wraps"] = soakWraps;
+  json["heapBaseline"] = soakHeapBaseline;
+  json["heapMin"] = soakHeapMin;
+  json["loopMaxMs"] = soakLoopMaxMs;
+
+  JsonObject violations = json.createNestedObject("violations");
+  for (uint8_t i = 0; i < SOAK_CHECK_COUNT; i++)
+  {
+    violations[SOAK_CHECK_NAMES[i]] = soakViolations[i];
+  }
+}
+#endif
+
+#ifdef FAULT_INJECTION
+void getFaultStats(JsonObject json)
+{
+  JsonObject injected = json.createNestedObject("injected");
+  for (uint8_t i = 0; i < FAULT_COUNT; i++)
+  {
+    injected[FAULT_NAMES[i]] = faultsInjected[i];
+  }
+
+  json["recoveries"] = faultRecoveries;
+  json["recoveryAvgMs"] = faultRecoveries ? faultRecoveryTotalMs / faultRecoveries : 0;
+  json["recoveryMaxMs"] = faultRecoveryMaxMs;
+}
+
+void faultStatsReset()
+{
+  memset(faultsInjected, 0, sizeof(faultsInjected));
+  faultSinceMs = 0L;
+  faultRecoveries = 0L;
+  faultRecoveryTotalMs = 0L;
+  faultRecoveryMaxMs = 0L;
+}
+
+void faultSweep(uint16_t polls)
+{
+  oxrs.println(F("[rfid] sweeping fault rates, keep a card on the reader..."));
+
+  TagJsonDocument json(2048);
+  JsonObject sweepJson = json.createNestedObject("faultSweep");
+  JsonArray stepsJson = sweepJson.createNestedArray("steps");
+
+  // the configured rates are the top of the sweep
+  uint16_t configuredRates[FAULT_COUNT];
+  memcpy(configuredRates, faultRates, sizeof(faultRates));
+
+  byte uid[MAX_UID_BYTES];
+  uint8_t uidLength;
+  uint8_t cardType;
+
+  for (uint8_t step = 0; step < FAULT_SWEEP_STEPS; step++)
+  {
+    uint8_t percent = step * 100 / (FAULT_SWEEP_STEPS - 1);
+    for (uint8_t i = 0; i < FAULT_COUNT; i++)
+    {
+      faultRates[i] = (uint32_t)configuredRates[i] * percent / 100;
+    }
+    faultStatsReset();
+
+    uint16_t detected = 0;
+    uint16_t reads = 0;
+    uint32_t detectTotalUs = 0L;
+    uint32_t readTotalUs = 0L;
+    uint32_t startMs = millis();
+
+    for (uint16_t poll = 0; poll < polls; poll++)
+    {
+      uint32_t startUs = micros();
+      bool found = reader->detect(uid, &uidLength, &cardType, detectTuner.timeoutMs);
+      detectTotalUs += micros() - startUs;
+
+      if (found)
+      {
+        detected++;
+
+        // each read starts from scratch and gives back its arena space
+        size_t arenaMark = tagArenaUsed;
+        resumeUidLength = 0;
+        startUs = micros();
+        NfcTag tag;
+        if (readTag(uid, uidLength, cardType, &tag)) { reads++; }
+        readTotalUs += micros() - startUs;
+        tagArenaUsed = arenaMark;
+      }
+
+      yield();
+    }
+
+    uint32_t elapsedMs = millis() - startMs;
+
+    uint32_t injected = 0L;
+    for (uint8_t i = 0; i < FAULT_COUNT; i++) { injected += faultsInjected[i]; }
+
+    JsonObject stepJson = stepsJson.createNestedObject();
+    stepJson["percent"] = percent;
+    stepJson["injected"] = injected;
+    stepJson["detected"] = detected;
+    stepJson["detectAvgUs"] = detectTotalUs / polls;
+    stepJson["reads"] = reads;
+    stepJson["readAvgUs"] = detected ? readTotalUs / detected : 0;
+    stepJson["readsPerSec"] = elapsedMs ? (uint32_t)reads * 1000 / elapsedMs : 0;
+    stepJson["recoveries"] = faultRecoveries;
+    stepJson["recoveryAvgMs"] = faultRecoveries ? faultRecoveryTotalMs / faultRecoveries : 0;
+    stepJson["recoveryMaxMs"] = faultRecoveryMaxMs;
+  }
+
+  // back to the configured rates, with clean stats
+  memcpy(faultRates, configuredRates, sizeof(faultRates));
+  faultStatsReset();
+
+  sweepJson["polls"] = polls;
+  mqttPublishStatus(json.as<JsonVariant>());
+  tagArenaReset();
+
+  oxrs.println(F("[rfid] fault sweep complete"));
+}
+#endif
+
+void publishStats()
+{
+#ifdef ALLOC_TRACKER
+  // don't record our own reporting
+  allocTrackerArmed = false;
+#endif
+
+  TagJsonDocument json(2048);
+  JsonObject stats = json.createNestedObject("stats");
+  stats["uptimeMs"] = millis();
+
+  getHeapStats(stats.createNestedObject("heap"));
+  getStackStats(stats.createNestedObject("stack"));
+  getDetectStats(stats.createNestedObject("detect"));
+  getPresenceStats(stats.createNestedObject("presence"));
+  if (inventoryIntervalMs > 0)
+  {
+    getInventoryStats(stats.createNestedObject("inventory"));
+  }
+  if (accessLogEnabled)
+  {
+    getAccessLogStats(stats.createNestedObject("log"));
+  }
+  getReadStats(stats.createNestedObject("read"));
+  getRFStats(stats.createNestedObject("rf"));
+  getMqttStats(stats.createNestedObject("mqtt"));
+  getEventStats(stats.createNestedObject("events"));
+  getDecisionStats(stats.createNestedObject("decisions"));
+#ifdef FAULT_INJECTION
+  getFaultStats(stats.createNestedObject("faults"));
+#endif
+#ifdef VIRTUAL_CLOCK
+  getSoakStats(stats.createNestedObject("soak"));
+#endif
+#ifdef ALLOC_TRACKER
+  getAllocStats(stats.createNestedObject("alloc"));
+#endif
+
+  mqttPublishTelemetry(json.as<JsonVariant>());
+  tagArenaReset();
+
+#ifdef ALLOC_TRACKER
+  allocTrackerArmed = true;
+#endif
+}
+
+#ifdef BENCHMARK
+void publishBenchmark()
+{
+  // the same report on every target, so readers/MCUs can be compared
+  // like for like (see tools/bench_compare.py)
+  TagJsonDocument json(1024);
+  JsonObject bench = json.createNestedObject("bench");
+
+#if defined(OXRS_ESP32)
+  bench["mcu"] = ESP.getChipModel();
+#elif defined(OXRS_ESP8266)
+  bench["mcu"] = "ESP8266";
+#endif
+  bench["cpuMHz"] = ESP.getCpuFreqMHz();
+  bench["reader"] = reader->name();
+#if defined(USE_PN532_NFC) && defined(USE_I2C_NFC)
+  bench["bus"] = "i2c";
+#else
+  bench["bus"] = "spi";
+#endif
+  bench["windowMs"] = millis() - lastBenchmarkMs;
+
+  JsonObject phases = bench.createNestedObject("phases");
+  for (uint8_t i = 0; i < PHASE_COUNT; i++)
+  {
+    PhaseTiming * timing = &phaseTimings[i];
+
+    JsonObject phase = phases.createNestedObject(PHASE_NAMES[i]);
+    phase["count"] = timing->count;
+    phase["avgUs"] = timing->count ? timing->totalUs / timing->count : 0;
+    phase["maxUs"] = timing->maxUs;
+    phase["stackFree"] = LOOP_STACK_BYTES - stackHighWater[i];
+  }
+
+  getHeapStats(bench.createNestedObject("heap"));
+
+  // one line on serial so it can be captured without a broker
+  Serial.print(F("[bench] "));
+  serializeJson(bench, Serial);
+  Serial.println();
+
+  mqttPublishTelemetry(json.as<JsonVariant>());
+  tagArenaReset();
+
+  // each report covers a fresh window
+  memset(phaseTimings, 0, sizeof(phaseTimings));
+}
+#endif
+
+void apiGetState(Request &req, Response &res)
+{
+  StaticJsonDocument<128> json;
+  getPadState(json.to<JsonObject>());
+
+  res.set("Content-Type", "application/json");
+  serializeJson(json, res);
+}
+
+void apiGetLog(Request &req, Response &res)
+{
+  // taps between from and to (unix seconds, inclusive), oldest first
+  char param[16];
+  uint32_t fromSecs = req.query("from", param, sizeof(param)) ? strtoul(param, NULL, 10) : 0L;
+  uint32_t toSecs = req.query("to", param, sizeof(param)) ? strtoul(param, NULL, 10) : 0xFFFFFFFF;
+  uint32_t limit = req.query("limit", param, sizeof(param)) ? strtoul(param, NULL, 10) : ACCESS_LOG_QUERY_LIMIT;
+  limit = min(limit, (uint32_t)ACCESS_LOG_QUERY_LIMIT);
+
+  // include taps still waiting to be written
+  accessLogFlush();
+
+  uint32_t startUs = micros();
+  uint32_t scanned = 0L;
+  uint32_t matched = 0L;
+  bool done = false;
+
+  res.set("Content-Type", "application/json");
+  res.print(F("{\"records\":["));
+
+  uint16_t blocksPerSegment = ACCESS_LOG_SEGMENT_RECORDS / ACCESS_LOG_INDEX_EVERY;
+  uint32_t block = accessLogSeek(fromSecs);
+
+  for (uint8_t i = block / blocksPerSegment; !done && i < accessLogSegmentCount; i++)
+  {
+    AccessLogSegment * segment = accessLogSegment(i);
+
+    char path[32];
+    File file = LittleFS.open(accessLogPath(path, segment->id), "r");
+    if (!file)
+      continue;
+
+    // only the first segment starts part way through
+    uint16_t index = i == block / blocksPerSegment ? (block % blocksPerSegment) * ACCESS_LOG_INDEX_EVERY : 0;
+    file.seek(index * sizeof(AccessLogRecord));
+
+    AccessLogRecord record;
+    for (; index < segment->records && file.read((uint8_t *)&record, sizeof(record)) == sizeof(record); index++)
+    {
+      scanned++;
+
+      // timestamps are monotonic, so the first one past the range ends it
+      if (record.timeSecs > toSecs) { done = true; break; }
+
+      // taps before the clock was set only show up in unbounded queries
+      if (record.timeSecs < fromSecs || (record.timeSecs == 0 && fromSecs > 0)) { continue; }
+
+      if (matched == limit) { done = true; break; }
+
+      char buffer[MAX_UID_BYTES * 2 + 1];
+      if (matched++ > 0) { res.print(','); }
+      res.print(F("{\"time\":"));
+      res.print(record.timeSecs);
+      res.print(F(",\"uptimeMs\":"));
+      res.print(record.uptimeMs);
+      res.print(F(",\"uid\":\""));
+      res.print(toHexString(buffer, record.uid, record.uidLength < MAX_UID_BYTES ? record.uidLength : MAX_UID_BYTES));
+      res.print(F("\",\"cardType\":\""));
+      res.print(CARD_TYPE_NAMES[record.cardType < CARD_TYPE_COUNT ? record.cardType : CARD_UNKNOWN]);
+      res.print(F("\",\"rejected\":"));
+      res.print(record.flags & ACCESS_LOG_REJECTED ? F("true") : F("false"));
+      res.print('}');
+    }
+
+    file.close();
+  }
+
+  res.print(F("],\"scanned\":"));
+  res.print(scanned);
+  res.print(F(",\"truncated\":"));
+  res.print(matched == limit && done ? F("true") : F("false"));
+  res.print('}');
+
+  accessLogQueryLastUs = micros() - startUs;
+  accessLogQueryMaxUs = max(accessLogQueryMaxUs, accessLogQueryLastUs);
+  accessLogQueryScanned = scanned;
+  accessLogQueries++;
+}
+
+void apiGetSpans(Request &req, Response &res)
+{
+  // streamed straight out so the export needs no buffer of its own
+  res.set("Content-Type", "application/json");
+
+  res.print(F("{\"cpuMHz\":"));
+  res.print(ESP.getCpuFreqMHz());
+
+  res.print(F(",\"names\":["));
+  for (uint8_t i = 0; i < SPAN_COUNT; i++)
+  {
+    if (i > 0) { res.print(','); }
+    res.print('"');
+    res.print(SPAN_NAMES[i]);
+    res.print('"');
+  }
+
+  // oldest first
+  res.print(F("],\"spans\":["));
+  uint16_t count = spanCount;
+  uint16_t index = (spanNext + SPAN_BUFFER_SIZE - count) % SPAN_BUFFER_SIZE;
+  for (uint16_t i = 0; i < count; i++)
+  {
+    Span * span = &spans[(index + i) % SPAN_BUFFER_SIZE];
+
+    if (i > 0) { res.print(','); }
+    res.print('[');
+    res.print(span->id);
+    res.print(',');
+    res.print(span->begin);
+    res.print(',');
+    res.print(span->cycles);
+    res.print(',');
+    res.print(span->ms);
+    res.print(']');
+  }
+
+  // a frozen buffer holds a slow tap, recording resumes once it's out
+  res.print(F("],\"frozen\":"));
+  res.print(spansFrozen ? F("true") : F("false"));
+  res.print('}');
+  spansFrozen = false;
+}
+
+void setConfigSchema()
+{
+  // Define our config schema (only built once, at startup)
+  DynamicJsonDocument json(4096);
+  
+  JsonObject tagReadIntervalMs = json.createNestedObject("tagReadIntervalMs");
+  tagReadIntervalMs["title"] = "Tag Read Interval (milliseconds)";
+  tagReadIntervalMs["description"] = "How often to check if a tag is near the reader (defaults to 200 milliseconds). Must be a number between 0 and 60000 (i.e. 1 min).";
+  tagReadIntervalMs["type"] = "integer";
+  tagReadIntervalMs["minimum"] = 0;
+  tagReadIntervalMs["maximum"] = 60000;
 
-#if defined(OXRS_ESP32)
-#include <OXRS_32.h>                  // ESP32 support
-OXRS_32 oxrs;
+  JsonObject detectTimeoutMs = json.createNestedObject("detectTimeoutMs");
+  detectTimeoutMs["title"] = "Detect Timeout (milliseconds)";
+  detectTimeoutMs["description"] = "How long to wait for a tag to respond on each poll. Leave at 0 (default) to auto-tune from measured response times.";
+  detectTimeoutMs["type"] = "integer";
+  detectTimeoutMs["minimum"] = 0;
+  detectTimeoutMs["maximum"] = MAX_DETECT_TIMEOUT_MS;
 
-#elif defined(OXRS_ESP8266)
-#include <OXRS_8266.h>                // ESP8266 support
-OXRS_8266 oxrs;
+  JsonObject rfMaxRetries = json.createNestedObject("rfMaxRetries");
+  rfMaxRetries["title"] = "RF Max Retries";
+  rfMaxRetries["description"] = "How many times the PN532 retries passive activation on each detection attempt (defaults to 255, i.e. retry until the timeout). Use the calibrate command to find the fastest reliable value.";
+  rfMaxRetries["type"] = "integer";
+  rfMaxRetries["minimum"] = 0;
+  rfMaxRetries["maximum"] = 255;
 
-#endif
+  JsonObject rfRxGain = json.createNestedObject("rfRxGain");
+  rfRxGain["title"] = "RF Receiver Gain";
+  rfRxGain["description"] = "PN532 receiver gain setting, 0 (18dB) to 7 (48dB) (defaults to 5, i.e. 38dB).";
+  rfRxGain["type"] = "integer";
+  rfRxGain["minimum"] = 0;
+  rfRxGain["maximum"] = 7;
 
-/*--------------------------- Constants -------------------------------*/
-// Serial
-#define     SERIAL_BAUD_RATE              115200
+  JsonObject ackWindow = json.createNestedObject("ackWindow");
+  ackWindow["title"] = "Ack Window (events)";
+  ackWindow["description"] = "How many events can be awaiting an ack command from the controller before sending pauses. Unacked events are resent after a reconnect or the ack timeout. Set to 0 (default) to disable acks.";
+  ackWindow["type"] = "integer";
+  ackWindow["minimum"] = 0;
+  ackWindow["maximum"] = EVENT_QUEUE_SIZE;
 
-// Time between tag reads
-#define     DEFAULT_TAG_READ_INTERVAL_MS  200
+  JsonObject ackTimeoutMs = json.createNestedObject("ackTimeoutMs");
+  ackTimeoutMs["title"] = "Ack Timeout (milliseconds)";
+  ackTimeoutMs["description"] = "How long to wait for an ack before resending an event (defaults to 5000 milliseconds).";
+  ackTimeoutMs["type"] = "integer";
+  ackTimeoutMs["minimum"] = 100;
 
-// Max NFC tag UID length
-#define     MAX_UID_BYTES                 8
+  JsonObject decisionTtlSecs = json.createNestedObject("decisionTtlSecs");
+  decisionTtlSecs["title"] = "Decision TTL (seconds)";
+  decisionTtlSecs["description"] = "How long a controller access decision is cached for when the decision command has no TTL (defaults to 60 seconds). Set to 0 to disable caching.";
+  decisionTtlSecs["type"] = "integer";
+  decisionTtlSecs["minimum"] = 0;
 
-/*--------------------------- Instantiate Globals ---------------------*/
-// RFID reader
-#ifdef USE_I2C_NFC
-PN532_I2C pn532_i2c(Wire);
-NfcAdapter nfc = NfcAdapter(pn532_i2c);
-#else
-PN532_SPI pn532_spi(SPI, SPI_SS_PIN);
-NfcAdapter nfc = NfcAdapter(pn532_spi);
-#endif
+  JsonObject filterRules = json.createNestedObject("filterRules");
+  filterRules["title"] = "Tag Filter Rules";
+  filterRules["description"] = "Rules checked in order as soon as a tag is detected, before it is read. The first rule to match allows or rejects the tag. Rejected tags are not read or published.";
+  filterRules["type"] = "array";
+  filterRules["maxItems"] = MAX_FILTER_RULES;
 
-// Last tag read and when
-uint32_t tagReadIntervalMs = DEFAULT_TAG_READ_INTERVAL_MS;
-uint32_t lastTagReadMs = 0L;
-byte lastUid[MAX_UID_BYTES];
+  JsonObject filterRulesItems = filterRules.createNestedObject("items");
+  filterRulesItems["type"] = "object";
 
-/*--------------------------- Program ---------------------------------*/
-char * toHexString(char buffer[], byte data[], uint8_t len)
-{
-  for (uint8_t i = 0; i < len; i++)
+  JsonObject filterRulesProperties = filterRulesItems.createNestedObject("properties");
+
+  JsonObject filterAction = filterRulesProperties.createNestedObject("action");
+  filterAction["title"] = "Action";
+  JsonArray filterActionEnum = filterAction.createNestedArray("enum");
+  filterActionEnum.add("allow");
+  filterActionEnum.add("reject");
+
+  JsonObject filterCardType = filterRulesProperties.createNestedObject("cardType");
+  filterCardType["title"] = "Card Type";
+  JsonArray filterCardTypeEnum = filterCardType.createNestedArray("enum");
+  for (uint8_t i = 0; i < CARD_TYPE_COUNT; i++)
   {
-    byte nib1 = (data[i] >> 4) & 0x0F;
-    byte nib2 = (data[i] >> 0) & 0x0F;
+    filterCardTypeEnum.add(CARD_TYPE_NAMES[i]);
+  }
 
-    buffer[i*2+0] = nib1  < 0xA ? '0' + nib1  : 'A' + nib1 - 0xA;
-    buffer[i*2+1] = nib2  < 0xA ? '0' + nib2  : 'A' + nib2 - 0xA;
+  JsonObject filterUidPrefix = filterRulesProperties.createNestedObject("uidPrefix");
+  filterUidPrefix["title"] = "UID Prefix (hex)";
+  filterUidPrefix["type"] = "string";
+
+  JsonObject filterUidMask = filterRulesProperties.createNestedObject("uidMask");
+  filterUidMask["title"] = "UID Prefix Mask (hex, defaults to FF for each prefix byte)";
+  filterUidMask["type"] = "string";
+
+  JsonObject filterUidLength = filterRulesProperties.createNestedObject("uidLength");
+  filterUidLength["title"] = "UID Length (bytes)";
+  filterUidLength["type"] = "integer";
+  filterUidLength["minimum"] = 0;
+  filterUidLength["maximum"] = MAX_UID_BYTES;
+
+  JsonArray filterRulesRequired = filterRulesItems.createNestedArray("required");
+  filterRulesRequired.add("action");
+
+  JsonObject filterDefault = json.createNestedObject("filterDefault");
+  filterDefault["title"] = "Tag Filter Default";
+  filterDefault["description"] = "What to do with tags that match none of the filter rules (defaults to allow).";
+  JsonArray filterDefaultEnum = filterDefault.createNestedArray("enum");
+  filterDefaultEnum.add("allow");
+  filterDefaultEnum.add("reject");
+
+  JsonObject presenceWindow = json.createNestedObject("presenceWindow");
+  presenceWindow["title"] = "Presence Window (polls)";
+  presenceWindow["description"] = "Number of recent polls the presence filter votes over (defaults to 3). Set to 1 to disable filtering.";
+  presenceWindow["type"] = "integer";
+  presenceWindow["minimum"] = 1;
+  presenceWindow["maximum"] = MAX_PRESENCE_WINDOW;
+
+  JsonObject presenceThreshold = json.createNestedObject("presenceThreshold");
+  presenceThreshold["title"] = "Presence Threshold (polls)";
+  presenceThreshold["description"] = "Number of polls within the window a tag must be detected in to be considered present (defaults to 1). Must not exceed the presence window.";
+  presenceThreshold["type"] = "integer";
+  presenceThreshold["minimum"] = 1;
+  presenceThreshold["maximum"] = MAX_PRESENCE_WINDOW;
+
+  JsonObject inventoryIntervalMs = json.createNestedObject("inventoryIntervalMs");
+  inventoryIntervalMs["title"] = "Inventory Interval (milliseconds)";
+  inventoryIntervalMs["description"] = "How often to publish the tags added to and removed from the reader since the last inventory report (defaults to 0, i.e. inventory mode disabled).";
+  inventoryIntervalMs["type"] = "integer";
+  inventoryIntervalMs["minimum"] = 0;
+
+  JsonObject inventorySnapshotEvery = json.createNestedObject("inventorySnapshotEvery");
+  inventorySnapshotEvery["title"] = "Inventory Snapshot Every (reports)";
+  inventorySnapshotEvery["description"] = "Publish the full set of tags on the reader every N inventory reports instead of just the changes (defaults to 10).";
+  inventorySnapshotEvery["type"] = "integer";
+  inventorySnapshotEvery["minimum"] = 1;
+  inventorySnapshotEvery["maximum"] = 65535;
+
+  JsonObject inventoryTimeoutMs = json.createNestedObject("inventoryTimeoutMs");
+  inventoryTimeoutMs["title"] = "Inventory Timeout (milliseconds)";
+  inventoryTimeoutMs["description"] = "How long a tag can go undetected before it is reported as removed from the inventory (defaults to 2000 milliseconds).";
+  inventoryTimeoutMs["type"] = "integer";
+  inventoryTimeoutMs["minimum"] = 0;
+
+  JsonObject usageIntervalMs = json.createNestedObject("usageIntervalMs");
+  usageIntervalMs["title"] = "Usage Interval (milliseconds)";
+  usageIntervalMs["description"] = "Count taps per UID and publish a usage summary as telemetry at this interval, instead of publishing every tap (defaults to 0, i.e. publish every tap).";
+  usageIntervalMs["type"] = "integer";
+  usageIntervalMs["minimum"] = 0;
+
+  JsonObject accessLog = json.createNestedObject("accessLog");
+  accessLog["title"] = "Access Log";
+  accessLog["description"] = "Keep a log of taps on flash, queryable from the REST API at /log?from=<unix secs>&to=<unix secs> (defaults to false).";
+  accessLog["type"] = "boolean";
+
+  JsonObject statsIntervalMs = json.createNestedObject("statsIntervalMs");
+  statsIntervalMs["title"] = "Stats Interval (milliseconds)";
+  statsIntervalMs["description"] = "How often to publish reader stats as telemetry (defaults to 60000 milliseconds). Set to 0 to disable.";
+  statsIntervalMs["type"] = "integer";
+  statsIntervalMs["minimum"] = 0;
+
+  JsonObject publishOnChange = json.createNestedObject("publishOnChange");
+  publishOnChange["title"] = "Publish On Change";
+  publishOnChange["description"] = "Only publish the UID and content digest when a tag is re-presented with unchanged content (defaults to false).";
+  publishOnChange["type"] = "boolean";
+
+  JsonObject publishRecordDeltas = json.createNestedObject("publishRecordDeltas");
+  publishRecordDeltas["title"] = "Publish Record Deltas";
+  publishRecordDeltas["description"] = "When a known tag is read with changed content, only publish the records that were added, removed or changed, with their indices (defaults to false).";
+  publishRecordDeltas["type"] = "boolean";
+
+#ifdef FAULT_INJECTION
+  JsonObject faultInjection = json.createNestedObject("faultInjection");
+  faultInjection["title"] = "Fault Injection";
+  faultInjection["description"] = "Rates (per 1000 transfers) at which to inject faults between the reader and the PN532, for resilience testing. Changing them resets the fault stats.";
+  faultInjection["type"] = "object";
+
+  JsonObject faultInjectionProperties = faultInjection.createNestedObject("properties");
+  for (uint8_t i = 0; i < FAULT_COUNT; i++)
+  {
+    JsonObject faultRate = faultInjectionProperties.createNestedObject(FAULT_NAMES[i]);
+    faultRate["type"] = "integer";
+    faultRate["minimum"] = 0;
+    faultRate["maximum"] = FAULT_RATE_SCALE;
   }
 
-  buffer[len*2] = '\0';
-  return buffer;
+  JsonObject faultStretchUs = faultInjectionProperties.createNestedObject("stretchUs");
+  faultStretchUs["title"] = "Clock Stretch (microseconds)";
+  faultStretchUs["type"] = "integer";
+  faultStretchUs["minimum"] = 0;
+  faultStretchUs["maximum"] = 65535;
+#endif
+
+  // Pass our config schema down to the hardware library
+  oxrs.setConfigSchema(json.as<JsonVariant>());
 }
 
-char * toAsciiString(char buffer[], byte data[], uint8_t len)
+void jsonConfig(JsonVariant json)
 {
-  for (uint8_t i = 0; i < len; i++)
+  if (json.containsKey("tagReadIntervalMs"))
   {
-    if (data[i] <= 0x1F) 
-    {
-      buffer[i] = '.';
-    } 
-    else 
-    {
-      buffer[i] = (char)data[i];
-    }
+    tagReadIntervalMs = json["tagReadIntervalMs"].as<uint32_t>();
   }
 
-  buffer[len] = '\0';
-  return buffer;
-}
+  if (json.containsKey("detectTimeoutMs"))
+  {
+    detectTuner.configMs = min(json["detectTimeoutMs"].as<uint32_t>(), (uint32_t)MAX_DETECT_TIMEOUT_MS);
+    detectTuner.timeoutMs = detectTuner.configMs > 0 ? detectTuner.configMs : DEFAULT_DETECT_TIMEOUT_MS;
+  }
 
-void publishTag(NfcTag * tag)
-{
-  // get the tag UID
-  byte uid[MAX_UID_BYTES];
-  tag->getUid(uid, tag->getUidLength());
+  if (json.containsKey("rfMaxRetries"))
+  {
+    rfMaxRetries = json["rfMaxRetries"].as<uint8_t>();
+    rfConfigPending = true;
+  }
 
-  // build the JSON payload with the tag details
-  DynamicJsonDocument json(4096);
-  char buffer[1024];
+  if (json.containsKey("rfRxGain"))
+  {
+    rfRxGain = min(json["rfRxGain"].as<uint8_t>(), (uint8_t)7);
+    rfConfigPending = true;
+  }
+
+  if (json.containsKey("ackWindow"))
+  {
+    ackWindow = min(json["ackWindow"].as<uint8_t>(), (uint8_t)EVENT_QUEUE_SIZE);
+  }
 
-  json["uid"] = toHexString(buffer, uid, tag->getUidLength());
-  json["type"] = tag->getTagType();
+  if (json.containsKey("ackTimeoutMs"))
+  {
+    ackTimeoutMs = max(json["ackTimeoutMs"].as<uint32_t>(), (uint32_t)100);
+  }
 
-  // does this tag have a message?
-  if (tag->hasNdefMessage())
+  if (json.containsKey("decisionTtlSecs"))
   {
-    NdefMessage ndefMessage = tag->getNdefMessage();
+    decisionTtlSecs = json["decisionTtlSecs"].as<uint32_t>();
+  }
 
-    JsonArray recordsJson = json.createNestedArray("records");
-    for (uint8_t i = 0; i < ndefMessage.getRecordCount(); i++)
+  if (json.containsKey("filterRules"))
+  {
+    filterRuleCount = 0;
+    for (JsonObject ruleJson : json["filterRules"].as<JsonArray>())
     {
-      NdefRecord ndefRecord = ndefMessage.getRecord(i);
+      if (filterRuleCount >= MAX_FILTER_RULES)
+        break;
 
-      int payloadLength = ndefRecord.getPayloadLength();
-      byte payload[payloadLength];
-      ndefRecord.getPayload(payload);
+      FilterRule * rule = &filterRules[filterRuleCount++];
+      rule->allow = strcmp(ruleJson["action"] | "allow", "allow") == 0;
+      rule->uidLength = ruleJson["uidLength"] | 0;
 
-      JsonObject recordJson = recordsJson.createNestedObject();
-      recordJson["tnf"] = ndefRecord.getTnf();
-      recordJson["type"] = ndefRecord.getType();
-      recordJson["id"] = ndefRecord.getId();
-      recordJson["bytes"] = ndefRecord.getEncodedSize();
+      rule->cardType = -1;
+      for (uint8_t i = 0; i < CARD_TYPE_COUNT; i++)
+      {
+        if (strcmp(ruleJson["cardType"] | "", CARD_TYPE_NAMES[i]) == 0) { rule->cardType = i; }
+      }
 
-      JsonObject payloadJson = recordJson.createNestedObject("payload");
-      payloadJson["hex"] = toHexString(buffer, payload, payloadLength);
-      payloadJson["ascii"] = toAsciiString(buffer, payload, payloadLength);
+      rule->prefixLength = fromHexString(rule->prefix, ruleJson["uidPrefix"] | "", MAX_UID_BYTES);
+      memset(rule->mask, 0xFF, MAX_UID_BYTES);
+      fromHexString(rule->mask, ruleJson["uidMask"] | "", rule->prefixLength);
     }
   }
 
-  // publish the tag details
-  oxrs.publishStatus(json.as<JsonVariant>());
-}
+  if (json.containsKey("filterDefault"))
+  {
+    filterDefaultAllow = strcmp(json["filterDefault"] | "allow", "reject") != 0;
+  }
 
-void processPN532() 
-{
-  // if no tag present then ensure we are ready to read a new one
-  if (!nfc.tagPresent(5))
+  if (json.containsKey("presenceWindow"))
   {
-    memset(lastUid, 0, MAX_UID_BYTES);
-    return;
+    presence.window = constrain(json["presenceWindow"].as<uint8_t>(), 1, MAX_PRESENCE_WINDOW);
   }
 
-  // read the tag details
-  NfcTag tag = nfc.read();
+  if (json.containsKey("presenceThreshold"))
+  {
+    presence.threshold = constrain(json["presenceThreshold"].as<uint8_t>(), 1, MAX_PRESENCE_WINDOW);
+  }
 
-  // get the tag UID
-  byte uid[MAX_UID_BYTES];
-  tag.getUid(uid, tag.getUidLength());
+  // a threshold larger than the window could never be met
+  presence.threshold = min(presence.threshold, presence.window);
 
-  // if the tag hasn't changed then nothing to do
-  if (memcmp(uid, lastUid, tag.getUidLength()) == 0) 
-    return;
+  if (json.containsKey("inventoryIntervalMs"))
+  {
+    inventoryIntervalMs = json["inventoryIntervalMs"].as<uint32_t>();
 
-  // save the tag UID so we can ignore re-reads
-  memcpy(lastUid, uid, tag.getUidLength());
+    // start from a clean slate, the next report is a snapshot
+    inventoryCount = 0;
+    inventoryReports = 0;
+  }
 
-  // publish the tag details
-  publishTag(&tag);
+  if (json.containsKey("inventorySnapshotEvery"))
+  {
+    inventorySnapshotEvery = max(json["inventorySnapshotEvery"].as<uint16_t>(), (uint16_t)1);
+  }
+
+  if (json.containsKey("inventoryTimeoutMs"))
+  {
+    inventoryTimeoutMs = json["inventoryTimeoutMs"].as<uint32_t>();
+  }
+
+  if (json.containsKey("usageIntervalMs"))
+  {
+    usageIntervalMs = json["usageIntervalMs"].as<uint32_t>();
+    usagePeriodStartMs = millis();
+  }
+
+  if (json.containsKey("accessLog"))
+  {
+    accessLogEnabled = json["accessLog"].as<bool>();
+    if (accessLogEnabled && !accessLogMounted)
+    {
+      accessLogBegin();
+    }
+  }
+
+#ifdef FAULT_INJECTION
+  if (json.containsKey("faultInjection"))
+  {
+    JsonObject faultInjection = json["faultInjection"];
+    for (uint8_t i = 0; i < FAULT_COUNT; i++)
+    {
+      faultRates[i] = constrain(faultInjection[FAULT_NAMES[i]] | 0, 0, FAULT_RATE_SCALE);
+    }
+    faultStretchUs = faultInjection["stretchUs"] | 0;
+
+    // each run of a benchmark starts from clean numbers
+    faultStatsReset();
+  }
+#endif
+
+  if (json.containsKey("statsIntervalMs"))
+  {
+    statsIntervalMs = json["statsIntervalMs"].as<uint32_t>();
+  }
+
+  if (json.containsKey("publishOnChange"))
+  {
+    publishOnChange = json["publishOnChange"].as<bool>();
+  }
+
+  if (json.containsKey("publishRecordDeltas"))
+  {
+    publishRecordDeltas = json["publishRecordDeltas"].as<bool>();
+  }
 }
 
-void setConfigSchema()
+void setCommandSchema()
 {
-  // Define our config schema
-  StaticJsonDocument<1024> json;
-  
-  JsonObject tagReadIntervalMs = json.createNestedObject("tagReadIntervalMs");
-  tagReadIntervalMs["title"] = "Tag Read Interval (milliseconds)";
-  tagReadIntervalMs["description"] = "How often to check if a tag is near the reader (defaults to 200 milliseconds). Must be a number between 0 and 60000 (i.e. 1 min).";
-  tagReadIntervalMs["type"] = "integer";
-  tagReadIntervalMs["minimum"] = 0;
-  tagReadIntervalMs["maximum"] = 60000;
+  // Define our command schema
+  DynamicJsonDocument json(2048);
 
-  // Pass our config schema down to the hardware library
-  oxrs.setConfigSchema(json.as<JsonVariant>());
+  JsonObject calibrate = json.createNestedObject("calibrate");
+  calibrate["title"] = "Calibrate RF";
+  calibrate["description"] = "Sweep the PN532 RF retry setting against a card held on the reader and apply the fastest reliable value (results are published as status).";
+  calibrate["type"] = "boolean";
+
+  JsonObject decision = json.createNestedObject("decision");
+  decision["title"] = "Access Decision";
+  decision["description"] = "Controller allow/deny reply for a published tag. Cached so repeat taps within the TTL are decided on the reader.";
+  decision["type"] = "object";
+
+  JsonObject decisionProperties = decision.createNestedObject("properties");
+
+  JsonObject decisionUid = decisionProperties.createNestedObject("uid");
+  decisionUid["title"] = "UID (hex)";
+  decisionUid["type"] = "string";
+
+  JsonObject decisionAllow = decisionProperties.createNestedObject("allow");
+  decisionAllow["title"] = "Allow";
+  decisionAllow["type"] = "boolean";
+
+  JsonObject decisionTtlSecs = decisionProperties.createNestedObject("ttlSecs");
+  decisionTtlSecs["title"] = "TTL (seconds, defaults to the decisionTtlSecs config)";
+  decisionTtlSecs["type"] = "integer";
+  decisionTtlSecs["minimum"] = 0;
+
+  JsonArray decisionRequired = decision.createNestedArray("required");
+  decisionRequired.add("uid");
+  decisionRequired.add("allow");
+
+  JsonObject ack = json.createNestedObject("ack");
+  ack["title"] = "Acknowledge Event";
+  ack["description"] = "Sequence number of a received event, only needed if ackWindow is configured.";
+  ack["type"] = "integer";
+  ack["minimum"] = 1;
+
+  JsonObject logBenchmark = json.createNestedObject("logBenchmark");
+  logBenchmark["title"] = "Benchmark Access Log";
+  logBenchmark["description"] = "Time appends, scans and seeks of this many records on a scratch file alongside the access log (results are published as status).";
+  logBenchmark["type"] = "integer";
+  logBenchmark["minimum"] = 1;
+  logBenchmark["maximum"] = MAX_LOG_BENCHMARK_RECORDS;
+
+#ifdef FAULT_INJECTION
+  JsonObject faultSweep = json.createNestedObject("faultSweep");
+  faultSweep["title"] = "Fault Sweep";
+  faultSweep["description"] = "Poll a card held on the reader this many times at each of 0, 25, 50, 75 and 100% of the configured fault rates, reporting detection latency, read throughput and recovery time per step (results are published as status).";
+  faultSweep["type"] = "integer";
+  faultSweep["minimum"] = 1;
+  faultSweep["maximum"] = MAX_FAULT_SWEEP_POLLS;
+#endif
+
+#ifdef VIRTUAL_CLOCK
+  JsonObject clockSkipMs = json.createNestedObject("clockSkipMs");
+  clockSkipMs["title"] = "Skip Clock (milliseconds)";
+  clockSkipMs["description"] = "Jump the virtual clock forward, e.g. past a millis() wrap or a TTL, for soak testing.";
+  clockSkipMs["type"] = "integer";
+  clockSkipMs["minimum"] = 1;
+
+  JsonObject clockSpeed = json.createNestedObject("clockSpeed");
+  clockSpeed["title"] = "Clock Speed";
+  clockSpeed["description"] = "Run the virtual clock this many times faster than real time, e.g. 1000 to cover a day of timers in under 90 seconds, for soak testing.";
+  clockSpeed["type"] = "integer";
+  clockSpeed["minimum"] = 1;
+  clockSpeed["maximum"] = MAX_CLOCK_SPEED;
+#endif
+
+  // Pass our command schema down to the hardware library
+  oxrs.setCommandSchema(json.as<JsonVariant>());
 }
 
-void jsonConfig(JsonVariant json)
+void jsonCommand(JsonVariant json)
 {
-  if (json.containsKey("tagReadIntervalMs"))
+  if (json.containsKey("calibrate") && json["calibrate"].as<bool>())
   {
-    tagReadIntervalMs = json["tagReadIntervalMs"].as<uint32_t>();
+    calibrationPending = true;
+  }
+
+  if (json.containsKey("ack"))
+  {
+    eventQueueAck(json["ack"].as<uint32_t>());
+  }
+
+#ifdef VIRTUAL_CLOCK
+  if (json.containsKey("clockSkipMs"))
+  {
+    clockVirtualMs += json["clockSkipMs"].as<uint32_t>();
+  }
+
+  if (json.containsKey("clockSpeed"))
+  {
+    clockSpeed = constrain(json["clockSpeed"].as<uint16_t>(), 1, MAX_CLOCK_SPEED);
+  }
+#endif
+
+  if (json.containsKey("logBenchmark"))
+  {
+    logBenchmarkPending = min(json["logBenchmark"] | (uint32_t)DEFAULT_LOG_BENCHMARK_RECORDS, (uint32_t)MAX_LOG_BENCHMARK_RECORDS);
+  }
+
+#ifdef FAULT_INJECTION
+  if (json.containsKey("faultSweep"))
+  {
+    faultSweepPending = constrain(json["faultSweep"] | DEFAULT_FAULT_SWEEP_POLLS, 1, MAX_FAULT_SWEEP_POLLS);
+  }
+#endif
+
+  if (json.containsKey("decision"))
+  {
+    JsonObject decision = json["decision"];
+
+    byte uid[MAX_UID_BYTES];
+    uint8_t uidLength = fromHexString(uid, decision["uid"] | "", MAX_UID_BYTES);
+    uint32_t ttlSecs = decision["ttlSecs"] | decisionTtlSecs;
+
+    // a decisionTtlSecs of 0 turns caching off, whatever the controller asks
+    if (uidLength > 0 && ttlSecs > 0 && decisionTtlSecs > 0)
+    {
+      decisionStore(uid, uidLength, decision["allow"] | false, ttlSecs);
+    }
   }
 }
 
 /**
   Initialisation
 */
-void initialisePN532(void)
+void initialiseReader(void)
 {
-  oxrs.print("[rfid] scanning for NFC reader on ");
+  oxrs.print(F("[rfid] scanning for "));
+  oxrs.print(reader->name());
+  oxrs.print(F(" reader on "));
 
-#ifdef USE_I2C_NFC
+#if defined(USE_PN532_NFC) && defined(USE_I2C_NFC)
   oxrs.println(F("I2C"));
   Wire.begin();
 #else
@@ -198,8 +3868,13 @@ void initialisePN532(void)
   SPI.begin();
 #endif
 
-  // Initialise the PN532 reader
-  nfc.begin();
+  // Initialise the reader
+  if (!reader->begin())
+  {
+    oxrs.print(F("[rfid] no "));
+    oxrs.print(reader->name());
+    oxrs.println(F(" found"));
+  }
 }
 
 /**
@@ -207,18 +3882,40 @@ void initialisePN532(void)
 */
 void setup() 
 {
+#ifdef SERIAL_EVENTS
+  Serial.begin(SERIAL_EVENT_BAUD_RATE);
+#else
   Serial.begin(SERIAL_BAUD_RATE);
+#endif
   delay(1000);
   Serial.println(F("[rfid] starting up..."));
   
   // Start hardware
-  oxrs.begin(jsonConfig, NULL);
+  oxrs.begin(jsonConfig, jsonCommand);
 
   // Set up the RFID reader
-  initialisePN532();
+  initialiseReader();
 
-  // Set up the config schema (for self-discovery and adoption)
+  // Set up the config and command schemas (for self-discovery and adoption)
   setConfigSchema();
+  setCommandSchema();
+
+  // Expose what is on the reader so late joiners can sync without a tap
+  oxrs.apiGet("/state", &apiGetState);
+
+  // Expose the access log for audits
+  oxrs.apiGet("/log", &apiGetLog);
+
+  // Access log timestamps need the wall clock
+  configTime(0, 0, NTP_SERVER);
+
+  // Expose the span buffer for timeline export
+  oxrs.apiGet("/spans", &apiGetSpans);
+
+#ifdef ALLOC_TRACKER
+  // Anything allocated from here on is steady-state
+  allocTrackerArmed = true;
+#endif
 }
 
 /**
@@ -226,16 +3923,135 @@ void setup()
 */
 void loop() 
 {
+#ifdef VIRTUAL_CLOCK
+  // timed on micros() so a clock skip doesn't look like a stall
+  uint32_t loopStartUs = micros();
+#endif
+
   // Let hardware handle any events etc
+  uint32_t oxrsStartUs = micros();
+  spanBegin(SPAN_OXRS);
   oxrs.loop();
+  spanEnd(SPAN_OXRS);
+  if ((micros() - oxrsStartUs) < SPAN_MIN_US) { spanDiscard(SPAN_OXRS); }
+
+  // Don't hold on to a slow tap's timeline forever
+  if (spansFrozen && (millis() - spansFrozenMs) > SPAN_FREEZE_HOLD_MS)
+  {
+    spansFrozen = false;
+  }
+
+#ifdef VIRTUAL_CLOCK
+  bool slowLoop = calibrationPending || logBenchmarkPending > 0;
+#ifdef FAULT_INJECTION
+  slowLoop |= faultSweepPending > 0;
+#endif
+#endif
+
+  // Apply any RF config changes, or run a requested calibration
+  if (calibrationPending)
+  {
+    calibrationPending = false;
+    rfConfigPending = false;
+    calibrateRF();
+  }
+  else if (rfConfigPending)
+  {
+    rfConfigPending = false;
+    reader->applyRFConfig();
+  }
+
+  // Run a requested access log benchmark
+  if (logBenchmarkPending > 0)
+  {
+    if (accessLogMounted || LittleFS.begin())
+    {
+      logBenchmark(logBenchmarkPending);
+    }
+    logBenchmarkPending = 0L;
+  }
+
+#ifdef FAULT_INJECTION
+  // Run a requested fault sweep
+  if (faultSweepPending > 0)
+  {
+    faultSweep(faultSweepPending);
+    faultSweepPending = 0;
+  }
+#endif
+
+  // Replay any queued (or unacked) events, only probing now and then while
+  // the broker is down
+  if (eventQueueCount > 0 && (!mqttDown || (millis() - lastEventDrainMs) > MQTT_PROBE_INTERVAL_MS))
+  {
+    eventQueueDrain();
+    lastEventDrainMs = millis();
+  }
+
+  // Re-send the reader state after boot or a broker outage
+  if (padStatePending && !mqttDown && usageIntervalMs == 0)
+  {
+    padStatePending = false;
+    publishPadState();
+    tagArenaReset();
+  }
 
   // Check if we are ready to read another tag
   if ((millis() - lastTagReadMs) > tagReadIntervalMs)
   {
-    // Process RFID reader
-    processPN532();
+    // Drop anything expired before it could outlive a millis() wrap
+    expireStaleState();
+
+    // Process RFID reader, then log the taps now they have been published
+    processReader();
+    accessLogFlush();
 
     // Reset our timer
     lastTagReadMs = millis();
   }
+
+  // Report inventory changes at a fixed cadence
+  if (inventoryIntervalMs > 0 && (millis() - lastInventoryMs) > inventoryIntervalMs)
+  {
+    publishInventory();
+    tagArenaReset();
+    lastInventoryMs = millis();
+  }
+
+  // Publish usage summaries at the end of each period, holding on to the
+  // counts while the broker is down
+  if (usageIntervalMs > 0 && !mqttDown && (millis() - usagePeriodStartMs) > usageIntervalMs)
+  {
+    publishUsage();
+    tagArenaReset();
+  }
+
+  // Probe the broker while it is down so we notice (and time) the reconnect,
+  // any queued events being replayed already do that for us
+  if (mqttDown && eventQueueCount == 0 && (millis() - mqttLastProbeMs) > MQTT_PROBE_INTERVAL_MS)
+  {
+    mqttProbe();
+    mqttLastProbeMs = millis();
+  }
+
+  // Publish our stats periodically
+  if (statsIntervalMs > 0 && (millis() - lastStatsMs) > statsIntervalMs)
+  {
+    spanBegin(SPAN_STATS);
+    publishStats();
+    spanEnd(SPAN_STATS);
+    lastStatsMs = millis();
+  }
+
+#ifdef BENCHMARK
+  if ((millis() - lastBenchmarkMs) > BENCHMARK_INTERVAL_MS)
+  {
+    publishBenchmark();
+    lastBenchmarkMs = millis();
+  }
+#endif
+
+#ifdef VIRTUAL_CLOCK
+  soakCheck(loopStartUs, slowLoop);
+#endif
 }
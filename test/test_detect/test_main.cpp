@@ -0,0 +1,128 @@
+#include <unity.h>
+#include <RFIDCore.h>
+
+DetectTuner tuner;
+PresenceFilter presence;
+
+uint8_t cardA[] = { 0x04, 0x11, 0x22, 0x33 };
+uint8_t cardB[] = { 0x04, 0x44, 0x55, 0x66 };
+
+void setUp()
+{
+  tuner = { 0L, DEFAULT_DETECT_TIMEOUT_MS };
+  presence = { 3, 1 };
+}
+
+void tearDown() {}
+
+// one pass of the detect stage as processReader runs it, the tuner sees
+// the presence state from before this poll
+bool poll(bool detected, uint8_t uid[], uint32_t elapsedUs)
+{
+  tuneDetectTimeout(&tuner, presence.filtered, detected, elapsedUs, uid, 4);
+  return filterPresence(&presence, detected);
+}
+
+void test_timeout_tracks_response_time()
+{
+  for (uint8_t i = 0; i < MIN_DETECT_SAMPLES; i++) { poll(true, cardA, 3000); }
+  TEST_ASSERT_EQUAL_UINT32(3000, tuner.percentileUs);
+  TEST_ASSERT_EQUAL_UINT32(4, tuner.timeoutMs);
+}
+
+void test_removals_do_not_ratchet()
+{
+  // card answers in 3ms, held for 5 polls then off the reader for 10,
+  // the misses after each removal must not push the timeout up
+  for (uint8_t tap = 0; tap < 20; tap++)
+  {
+    for (uint8_t i = 0; i < 5; i++) { poll(true, cardA, 3000); }
+    for (uint8_t i = 0; i < 10; i++) { poll(false, cardA, tuner.timeoutMs * 1000); }
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(0, tuner.censored);
+  TEST_ASSERT_EQUAL_UINT32(3000, tuner.percentileUs);
+  TEST_ASSERT_EQUAL_UINT32(4, tuner.timeoutMs);
+}
+
+void test_quick_swap_is_not_censored()
+{
+  for (uint8_t i = 0; i < MIN_DETECT_SAMPLES; i++) { poll(true, cardA, 3000); }
+
+  // a different card inside the filter window is not a late answer
+  poll(false, cardA, 4000);
+  poll(true, cardB, 3000);
+  TEST_ASSERT_EQUAL_UINT32(0, tuner.censored);
+  TEST_ASSERT_EQUAL_UINT32(4, tuner.timeoutMs);
+}
+
+void test_missed_answer_raises_floor()
+{
+  for (uint8_t i = 0; i < MIN_DETECT_SAMPLES; i++) { poll(true, cardA, 3000); }
+
+  // the same card back after a miss, so we gave up on it too soon
+  TEST_ASSERT_TRUE(poll(false, cardA, 4000));
+  poll(true, cardA, 3000);
+  TEST_ASSERT_EQUAL_UINT32(1, tuner.censored);
+  TEST_ASSERT_EQUAL_UINT32(5, tuner.timeoutMs);
+
+  // held for a window of samples, then back to the percentile
+  for (uint8_t i = 0; i < DETECT_SAMPLES - 1; i++) { poll(true, cardA, 3000); }
+  TEST_ASSERT_EQUAL_UINT32(5, tuner.timeoutMs);
+  poll(true, cardA, 3000);
+  TEST_ASSERT_EQUAL_UINT32(4, tuner.timeoutMs);
+}
+
+void test_fixed_timeout()
+{
+  tuner.configMs = 20;
+  tuner.timeoutMs = 20;
+  for (uint8_t i = 0; i < DETECT_SAMPLES; i++) { poll(true, cardA, 3000); }
+  TEST_ASSERT_EQUAL_UINT32(20, tuner.timeoutMs);
+}
+
+void test_timeout_clamped()
+{
+  for (uint8_t i = 0; i < DETECT_SAMPLES; i++) { poll(true, cardA, 100); }
+  TEST_ASSERT_EQUAL_UINT32(MIN_DETECT_TIMEOUT_MS, tuner.timeoutMs);
+
+  for (uint8_t i = 0; i < DETECT_SAMPLES; i++) { poll(true, cardA, 80000); }
+  TEST_ASSERT_EQUAL_UINT32(MAX_DETECT_TIMEOUT_MS, tuner.timeoutMs);
+}
+
+void test_presence_holds_through_window()
+{
+  TEST_ASSERT_TRUE(poll(true, cardA, 3000));
+  TEST_ASSERT_TRUE(poll(false, cardA, 4000));
+  TEST_ASSERT_TRUE(poll(false, cardA, 4000));
+  TEST_ASSERT_FALSE(poll(false, cardA, 4000));
+}
+
+void test_presence_counts_flicker()
+{
+  poll(true, cardA, 3000);
+  poll(false, cardA, 4000);
+  poll(true, cardA, 3000);
+  TEST_ASSERT_EQUAL_UINT32(2, presence.flicker);
+
+  // without a window every edge gets through
+  setUp();
+  presence.window = 1;
+  TEST_ASSERT_TRUE(poll(true, cardA, 3000));
+  TEST_ASSERT_FALSE(poll(false, cardA, 4000));
+  TEST_ASSERT_EQUAL_UINT32(0, presence.flicker);
+}
+
+int main(int argc, char ** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_timeout_tracks_response_time);
+  RUN_TEST(test_removals_do_not_ratchet);
+  RUN_TEST(test_quick_swap_is_not_censored);
+  RUN_TEST(test_missed_answer_raises_floor);
+  RUN_TEST(test_fixed_timeout);
+  RUN_TEST(test_timeout_clamped);
+  RUN_TEST(test_presence_holds_through_window);
+  RUN_TEST(test_presence_counts_flicker);
+  return UNITY_END();
+}
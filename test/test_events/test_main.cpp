@@ -0,0 +1,122 @@
+#include <unity.h>
+#include <RFIDCore.h>
+
+#define     QUEUE_SIZE                    4
+#define     POOL_BYTES                    100
+
+EventSlot queue[QUEUE_SIZE];
+uint8_t head;
+uint8_t count;
+uint32_t dropped;
+
+void setUp()
+{
+  memset(queue, 0, sizeof(queue));
+  head = 0;
+  count = 0;
+  dropped = 0;
+}
+
+void tearDown() {}
+
+// queue an event the way eventQueuePush does, returns where it went
+int32_t push(uint16_t length, uint32_t seq)
+{
+  int32_t offset = eventPoolReserve(queue, QUEUE_SIZE, &head, &count, POOL_BYTES, length, &dropped);
+  if (offset < 0)
+    return offset;
+
+  EventSlot * slot = &queue[(head + count) % QUEUE_SIZE];
+  slot->seq = seq;
+  slot->offset = offset;
+  slot->length = length;
+  count++;
+  return offset;
+}
+
+void pop()
+{
+  head = (head + 1) % QUEUE_SIZE;
+  count--;
+}
+
+void test_fit_empty_pool()
+{
+  TEST_ASSERT_EQUAL_INT32(0, eventPoolFit(queue, QUEUE_SIZE, head, count, POOL_BYTES, POOL_BYTES));
+  TEST_ASSERT_EQUAL_INT32(-1, eventPoolFit(queue, QUEUE_SIZE, head, count, POOL_BYTES, POOL_BYTES + 1));
+}
+
+void test_events_packed_in_order()
+{
+  TEST_ASSERT_EQUAL_INT32(0, push(30, 1));
+  TEST_ASSERT_EQUAL_INT32(30, push(30, 2));
+  TEST_ASSERT_EQUAL_INT32(60, push(40, 3));
+  TEST_ASSERT_EQUAL_UINT8(3, count);
+  TEST_ASSERT_EQUAL_UINT32(0, dropped);
+}
+
+void test_wraps_once_head_frees()
+{
+  push(40, 1);
+  push(40, 2);
+  pop();
+
+  // no room after the tail, but the first 40 bytes are free again
+  TEST_ASSERT_EQUAL_INT32(0, push(30, 3));
+
+  // wrapped, so only the gap up to the head is left
+  TEST_ASSERT_EQUAL_INT32(-1, eventPoolFit(queue, QUEUE_SIZE, head, count, POOL_BYTES, 11));
+  TEST_ASSERT_EQUAL_INT32(30, push(10, 4));
+  TEST_ASSERT_EQUAL_UINT32(0, dropped);
+}
+
+void test_drops_oldest_for_room()
+{
+  push(40, 1);
+  push(40, 2);
+
+  // needs both the free tail and the first event's space
+  TEST_ASSERT_EQUAL_INT32(0, push(30, 3));
+  TEST_ASSERT_EQUAL_UINT32(1, dropped);
+  TEST_ASSERT_EQUAL_UINT8(2, count);
+  TEST_ASSERT_EQUAL_UINT32(2, queue[head].seq);
+}
+
+void test_drops_oldest_when_slots_full()
+{
+  for (uint32_t seq = 1; seq <= QUEUE_SIZE; seq++) { push(10, seq); }
+  TEST_ASSERT_EQUAL_INT32(40, push(10, QUEUE_SIZE + 1));
+  TEST_ASSERT_EQUAL_UINT32(1, dropped);
+  TEST_ASSERT_EQUAL_UINT8(QUEUE_SIZE, count);
+  TEST_ASSERT_EQUAL_UINT32(2, queue[head].seq);
+}
+
+void test_oversized_keeps_queue()
+{
+  push(10, 1);
+  TEST_ASSERT_EQUAL_INT32(-1, push(POOL_BYTES + 1, 2));
+  TEST_ASSERT_EQUAL_UINT32(0, dropped);
+  TEST_ASSERT_EQUAL_UINT8(1, count);
+}
+
+void test_full_pool_event_empties_queue()
+{
+  push(10, 1);
+  push(10, 2);
+  TEST_ASSERT_EQUAL_INT32(0, push(POOL_BYTES, 3));
+  TEST_ASSERT_EQUAL_UINT32(2, dropped);
+  TEST_ASSERT_EQUAL_UINT8(1, count);
+}
+
+int main(int argc, char ** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_fit_empty_pool);
+  RUN_TEST(test_events_packed_in_order);
+  RUN_TEST(test_wraps_once_head_frees);
+  RUN_TEST(test_drops_oldest_for_room);
+  RUN_TEST(test_drops_oldest_when_slots_full);
+  RUN_TEST(test_oversized_keeps_queue);
+  RUN_TEST(test_full_pool_event_empties_queue);
+  return UNITY_END();
+}
@@ -0,0 +1,121 @@
+#include <unity.h>
+#include <RFIDCore.h>
+
+void setUp() {}
+void tearDown() {}
+
+// reference decoder, so encoded frames can be checked by round trip
+uint16_t cobsDecode(uint8_t output[], uint8_t input[], uint16_t len)
+{
+  uint16_t out = 0;
+  uint16_t i = 0;
+  while (i < len)
+  {
+    uint8_t code = input[i++];
+    for (uint8_t j = 1; j < code; j++) { output[out++] = input[i++]; }
+    if (code != 0xFF && i < len) { output[out++] = 0x00; }
+  }
+  return out;
+}
+
+void test_crc16_check_value()
+{
+  // CRC-16/CCITT-FALSE check value
+  uint8_t data[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+  TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16(data, sizeof(data)));
+  TEST_ASSERT_EQUAL_HEX16(0xFFFF, crc16(data, 0));
+}
+
+void test_cobs_known_frames()
+{
+  uint8_t output[8];
+
+  uint8_t zero[] = { 0x00 };
+  const uint8_t zeroEncoded[] = { 0x01, 0x01 };
+  TEST_ASSERT_EQUAL_UINT16(2, cobsEncode(output, zero, sizeof(zero)));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(zeroEncoded, output, 2);
+
+  uint8_t mixed[] = { 0x11, 0x22, 0x00, 0x33 };
+  const uint8_t mixedEncoded[] = { 0x03, 0x11, 0x22, 0x02, 0x33 };
+  TEST_ASSERT_EQUAL_UINT16(5, cobsEncode(output, mixed, sizeof(mixed)));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(mixedEncoded, output, 5);
+}
+
+void test_cobs_round_trip_long_runs()
+{
+  // runs either side of the 254 byte block limit, with and without zeros
+  uint16_t lengths[] = { 1, 253, 254, 255, 300 };
+  for (uint8_t n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++)
+  {
+    uint8_t input[300];
+    for (uint16_t i = 0; i < lengths[n]; i++) { input[i] = (n & 1) && i % 100 == 50 ? 0x00 : (i % 255) + 1; }
+
+    uint8_t encoded[310];
+    uint16_t encodedLength = cobsEncode(encoded, input, lengths[n]);
+    for (uint16_t i = 0; i < encodedLength; i++) { TEST_ASSERT_NOT_EQUAL(0x00, encoded[i]); }
+
+    uint8_t decoded[310];
+    TEST_ASSERT_EQUAL_UINT16(lengths[n], cobsDecode(decoded, encoded, encodedLength));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(input, decoded, lengths[n]);
+  }
+}
+
+void test_ndef_tlv_found()
+{
+  // NULL TLV, lock control TLV, then the NDEF message
+  uint8_t data[] = { 0x00, 0x01, 0x03, 0xA0, 0x0C, 0x34, 0x03, 0x05, 0xD1, 0x01, 0x01, 0x54, 0x00, 0xFE };
+  uint16_t start = 0;
+  uint16_t length = 0;
+  TEST_ASSERT_EQUAL_INT8(1, findNdefTlv(data, sizeof(data), &start, &length));
+  TEST_ASSERT_EQUAL_UINT16(8, start);
+  TEST_ASSERT_EQUAL_UINT16(5, length);
+}
+
+void test_ndef_tlv_long_length()
+{
+  uint8_t data[] = { 0x03, 0xFF, 0x01, 0x20, 0xD1 };
+  uint16_t start = 0;
+  uint16_t length = 0;
+  TEST_ASSERT_EQUAL_INT8(1, findNdefTlv(data, sizeof(data), &start, &length));
+  TEST_ASSERT_EQUAL_UINT16(4, start);
+  TEST_ASSERT_EQUAL_UINT16(0x120, length);
+}
+
+void test_ndef_tlv_needs_more_data()
+{
+  uint16_t start = 0;
+  uint16_t length = 0;
+
+  // length byte not read yet
+  uint8_t shortData[] = { 0x00, 0x03 };
+  TEST_ASSERT_EQUAL_INT8(0, findNdefTlv(shortData, sizeof(shortData), &start, &length));
+
+  // three byte length cut short
+  uint8_t longData[] = { 0x03, 0xFF, 0x01 };
+  TEST_ASSERT_EQUAL_INT8(0, findNdefTlv(longData, sizeof(longData), &start, &length));
+
+  // a lock control TLV running past what has been read
+  uint8_t otherData[] = { 0x01, 0x03, 0xA0, 0x0C };
+  TEST_ASSERT_EQUAL_INT8(0, findNdefTlv(otherData, sizeof(otherData), &start, &length));
+}
+
+void test_ndef_tlv_terminator()
+{
+  uint8_t data[] = { 0x01, 0x01, 0x00, 0xFE, 0x03, 0x01 };
+  uint16_t start = 0;
+  uint16_t length = 0;
+  TEST_ASSERT_EQUAL_INT8(-1, findNdefTlv(data, sizeof(data), &start, &length));
+}
+
+int main(int argc, char ** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_crc16_check_value);
+  RUN_TEST(test_cobs_known_frames);
+  RUN_TEST(test_cobs_round_trip_long_runs);
+  RUN_TEST(test_ndef_tlv_found);
+  RUN_TEST(test_ndef_tlv_long_length);
+  RUN_TEST(test_ndef_tlv_needs_more_data);
+  RUN_TEST(test_ndef_tlv_terminator);
+  return UNITY_END();
+}
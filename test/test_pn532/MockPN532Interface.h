@@ -0,0 +1,65 @@
+#ifndef MOCK_PN532_INTERFACE_H
+#define MOCK_PN532_INTERFACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Error codes as returned by the PN532Interface implementations
+#define     PN532_INVALID_ACK             -1
+#define     PN532_TIMEOUT                 -2
+
+#define     MOCK_MAX_FRAMES               16
+#define     MOCK_MAX_FRAME_BYTES          64
+
+// Scripted stand-in for PN532Interface, hands back queued response frames
+// in order (a timeout once they run out) and records every command written
+class MockPN532Interface
+{
+  public:
+    uint8_t commands[MOCK_MAX_FRAMES];
+    uint8_t commandCount = 0;
+    uint16_t lastTimeout = 0;
+    bool nak = false;
+
+    void begin() {}
+    void wakeup() {}
+
+    void queue(const uint8_t frame[], uint8_t length)
+    {
+      memcpy(_frames[_frameCount], frame, length);
+      _lengths[_frameCount++] = length;
+    }
+
+    void queueTimeout()
+    {
+      _lengths[_frameCount++] = -1;
+    }
+
+    int8_t writeCommand(const uint8_t * header, uint8_t hlen, const uint8_t * body = 0, uint8_t blen = 0)
+    {
+      if (commandCount < MOCK_MAX_FRAMES) { commands[commandCount++] = header[0]; }
+      return nak ? PN532_INVALID_ACK : 0;
+    }
+
+    int16_t readResponse(uint8_t buf[], uint8_t len, uint16_t timeout = 1000)
+    {
+      lastTimeout = timeout;
+      if (_next >= _frameCount || _lengths[_next] < 0)
+      {
+        _next++;
+        return PN532_TIMEOUT;
+      }
+
+      int16_t length = _lengths[_next] < len ? _lengths[_next] : len;
+      memcpy(buf, _frames[_next++], length);
+      return length;
+    }
+
+  private:
+    uint8_t _frames[MOCK_MAX_FRAMES][MOCK_MAX_FRAME_BYTES];
+    int16_t _lengths[MOCK_MAX_FRAMES];
+    uint8_t _frameCount = 0;
+    uint8_t _next = 0;
+};
+
+#endif
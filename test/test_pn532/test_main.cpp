@@ -0,0 +1,181 @@
+#include <unity.h>
+#include <RFIDCore.h>
+#include "MockPN532Interface.h"
+
+MockPN532Interface * bus;
+
+void setUp()
+{
+  bus = new MockPN532Interface();
+}
+
+void tearDown()
+{
+  delete bus;
+}
+
+void test_detect_classic()
+{
+  // NbTg, Tg, ATQA, SAK, NFCIDLength, NFCID
+  const uint8_t frame[] = { 0x01, 0x01, 0x00, 0x04, 0x08, 0x04, 0xDE, 0xAD, 0xBE, 0xEF };
+  bus->queue(frame, sizeof(frame));
+
+  uint8_t uid[MAX_UID_BYTES];
+  uint8_t uidLength = 0;
+  uint8_t cardType = CARD_UNKNOWN;
+  TEST_ASSERT_TRUE(pn532ListTarget(*bus, uid, &uidLength, &cardType, 7));
+
+  const uint8_t expected[] = { 0xDE, 0xAD, 0xBE, 0xEF };
+  TEST_ASSERT_EQUAL_UINT8(4, uidLength);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, uid, 4);
+  TEST_ASSERT_EQUAL_UINT8(CARD_CLASSIC, cardType);
+  TEST_ASSERT_EQUAL_UINT8(PN532_COMMAND_INLISTPASSIVETARGET, bus->commands[0]);
+  TEST_ASSERT_EQUAL_UINT16(7, bus->lastTimeout);
+}
+
+void test_detect_no_target()
+{
+  const uint8_t frame[] = { 0x00 };
+  bus->queue(frame, sizeof(frame));
+
+  uint8_t uid[MAX_UID_BYTES];
+  uint8_t uidLength = 0;
+  uint8_t cardType;
+  TEST_ASSERT_FALSE(pn532ListTarget(*bus, uid, &uidLength, &cardType, 5));
+  TEST_ASSERT_EQUAL_UINT8(0, uidLength);
+}
+
+void test_detect_truncated_uid()
+{
+  // claims a 7 byte UID but the frame stops after 3
+  const uint8_t frame[] = { 0x01, 0x01, 0x00, 0x44, 0x00, 0x07, 0x04, 0x11, 0x22 };
+  bus->queue(frame, sizeof(frame));
+
+  uint8_t uid[MAX_UID_BYTES];
+  uint8_t uidLength = 0;
+  uint8_t cardType;
+  TEST_ASSERT_FALSE(pn532ListTarget(*bus, uid, &uidLength, &cardType, 5));
+  TEST_ASSERT_EQUAL_UINT8(0, uidLength);
+}
+
+void test_detect_uid_too_long()
+{
+  uint8_t frame[6 + MAX_UID_BYTES + 1] = { 0x01, 0x01, 0x00, 0x44, 0x00, MAX_UID_BYTES + 1 };
+  bus->queue(frame, sizeof(frame));
+
+  uint8_t uid[MAX_UID_BYTES];
+  uint8_t uidLength = 0;
+  uint8_t cardType;
+  TEST_ASSERT_FALSE(pn532ListTarget(*bus, uid, &uidLength, &cardType, 5));
+}
+
+void test_detect_nak_and_timeout()
+{
+  uint8_t uid[MAX_UID_BYTES];
+  uint8_t uidLength = 0;
+  uint8_t cardType;
+
+  bus->queueTimeout();
+  TEST_ASSERT_FALSE(pn532ListTarget(*bus, uid, &uidLength, &cardType, 5));
+
+  bus->nak = true;
+  TEST_ASSERT_FALSE(pn532ListTarget(*bus, uid, &uidLength, &cardType, 5));
+  TEST_ASSERT_EQUAL_UINT8(2, bus->commandCount);
+}
+
+void test_scan_two_targets_with_ats()
+{
+  // an ISO14443-4 target (with its ATS) then a 7 byte type 2 target
+  const uint8_t frame[] =
+  {
+    0x02,
+    0x01, 0x00, 0x04, 0x20, 0x04, 0x08, 0x11, 0x22, 0x33, 0x05, 0x75, 0x77, 0x81, 0x02,
+    0x02, 0x00, 0x44, 0x00, 0x07, 0x04, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6
+  };
+  const uint8_t status[] = { 0x00 };
+  const uint8_t empty[] = { 0x00 };
+  bus->queue(frame, sizeof(frame));
+  bus->queue(status, sizeof(status));
+  bus->queue(empty, sizeof(empty));
+
+  ScannedTag tags[4];
+  TEST_ASSERT_EQUAL_UINT8(2, pn532ListTargets(*bus, tags, 4, 5));
+
+  const uint8_t uid0[] = { 0x08, 0x11, 0x22, 0x33 };
+  const uint8_t uid1[] = { 0x04, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6 };
+  TEST_ASSERT_EQUAL_UINT8(4, tags[0].uidLength);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(uid0, tags[0].uid, 4);
+  TEST_ASSERT_EQUAL_UINT8(CARD_ISO14443_4, tags[0].cardType);
+  TEST_ASSERT_EQUAL_UINT8(7, tags[1].uidLength);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(uid1, tags[1].uid, 7);
+  TEST_ASSERT_EQUAL_UINT8(CARD_TYPE2, tags[1].cardType);
+
+  // list, deselect, then list again to find nothing new
+  const uint8_t commands[] = { PN532_COMMAND_INLISTPASSIVETARGET, PN532_COMMAND_INDESELECT, PN532_COMMAND_INLISTPASSIVETARGET };
+  TEST_ASSERT_EQUAL_UINT8(3, bus->commandCount);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(commands, bus->commands, 3);
+}
+
+void test_scan_truncated_second_target()
+{
+  const uint8_t frame[] =
+  {
+    0x02,
+    0x01, 0x00, 0x04, 0x08, 0x04, 0x01, 0x02, 0x03, 0x04,
+    0x02, 0x00, 0x44, 0x00, 0x07, 0x04, 0xA1
+  };
+  const uint8_t status[] = { 0x00 };
+  bus->queue(frame, sizeof(frame));
+  bus->queue(status, sizeof(status));
+
+  ScannedTag tags[4];
+  TEST_ASSERT_EQUAL_UINT8(1, pn532ListTargets(*bus, tags, 4, 5));
+  TEST_ASSERT_EQUAL_UINT8(CARD_CLASSIC, tags[0].cardType);
+}
+
+void test_scan_stops_on_repeat()
+{
+  // a tag that ignored the deselect answers again, nothing new so stop
+  const uint8_t frame[] = { 0x01, 0x01, 0x00, 0x04, 0x08, 0x04, 0x01, 0x02, 0x03, 0x04 };
+  const uint8_t status[] = { 0x00 };
+  bus->queue(frame, sizeof(frame));
+  bus->queue(status, sizeof(status));
+  bus->queue(frame, sizeof(frame));
+  bus->queue(status, sizeof(status));
+
+  ScannedTag tags[4];
+  TEST_ASSERT_EQUAL_UINT8(1, pn532ListTargets(*bus, tags, 4, 5));
+  TEST_ASSERT_EQUAL_UINT8(4, bus->commandCount);
+}
+
+void test_scan_respects_max_tags()
+{
+  const uint8_t frame[] =
+  {
+    0x02,
+    0x01, 0x00, 0x04, 0x08, 0x04, 0x01, 0x02, 0x03, 0x04,
+    0x02, 0x00, 0x04, 0x08, 0x04, 0x05, 0x06, 0x07, 0x08
+  };
+  const uint8_t status[] = { 0x00 };
+  bus->queue(frame, sizeof(frame));
+  bus->queue(status, sizeof(status));
+
+  ScannedTag tags[1];
+  TEST_ASSERT_EQUAL_UINT8(1, pn532ListTargets(*bus, tags, 1, 5));
+  TEST_ASSERT_EQUAL_UINT8(2, bus->commandCount);
+}
+
+int main(int argc, char ** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_detect_classic);
+  RUN_TEST(test_detect_no_target);
+  RUN_TEST(test_detect_truncated_uid);
+  RUN_TEST(test_detect_uid_too_long);
+  RUN_TEST(test_detect_nak_and_timeout);
+  RUN_TEST(test_scan_two_targets_with_ats);
+  RUN_TEST(test_scan_truncated_second_target);
+  RUN_TEST(test_scan_stops_on_repeat);
+  RUN_TEST(test_scan_respects_max_tags);
+  return UNITY_END();
+}
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+#
+# Compare benchmark reports from firmware built with -DBENCHMARK, one
+# captured serial log (or telemetry dump) per target, as a markdown table
+#
+#   pio device monitor -e esp32s3-spi > esp32s3-spi.log
+#   python tools/bench_compare.py d1mini-debug.log esp32s3-spi.log ...
+#
+# Every "[bench] {...}" line in a log is a report for one window, reports
+# are combined per target (weighted by count for averages, max for maxima).
+#
+
+import json
+import os
+import sys
+
+PREFIX = "[bench] "
+
+
+def load_reports(path):
+    reports = []
+    with open(path, errors="replace") as f:
+        for line in f:
+            index = line.find(PREFIX)
+            if index < 0:
+                continue
+            try:
+                reports.append(json.loads(line[index + len(PREFIX):]))
+            except ValueError:
+                pass
+    return reports
+
+
+def combine(reports):
+    phases = {}
+    heap_min = None
+    block_min = None
+    for report in reports:
+        for name, phase in report["phases"].items():
+            total = phases.setdefault(name, {"count": 0, "totalUs": 0, "maxUs": 0, "stackFree": None})
+            total["count"] += phase["count"]
+            total["totalUs"] += phase["avgUs"] * phase["count"]
+            total["maxUs"] = max(total["maxUs"], phase["maxUs"])
+            if total["stackFree"] is None or phase["stackFree"] < total["stackFree"]:
+                total["stackFree"] = phase["stackFree"]
+
+        heap = report["heap"]
+        heap_min = heap["free"] if heap_min is None else min(heap_min, heap["free"])
+        block_min = heap["maxBlock"] if block_min is None else min(block_min, heap["maxBlock"])
+
+    return phases, heap_min, block_min
+
+
+def main(paths):
+    rows = []
+    phase_names = []
+    for path in paths:
+        reports = load_reports(path)
+        if not reports:
+            print("no benchmark reports in %s" % path, file=sys.stderr)
+            continue
+
+        phases, heap_min, block_min = combine(reports)
+        for name in phases:
+            if name not in phase_names:
+                phase_names.append(name)
+
+        first = reports[0]
+        rows.append((os.path.splitext(os.path.basename(path))[0], first, phases, heap_min, block_min))
+
+    header = ["target", "mcu", "MHz", "reader", "bus"]
+    for name in phase_names:
+        header += ["%s avg/max us" % name, "%s stack free" % name]
+    header += ["min free heap", "min max block"]
+
+    print("|" + "|".join(header) + "|")
+    print("|" + "|".join("---" for _ in header) + "|")
+
+    for target, first, phases, heap_min, block_min in rows:
+        cells = [target, str(first.get("mcu")), str(first.get("cpuMHz")), str(first.get("reader")), str(first.get("bus"))]
+        for name in phase_names:
+            phase = phases.get(name)
+            if not phase or phase["count"] == 0:
+                cells += ["-", "-"]
+                continue
+            cells.append("%d/%d" % (phase["totalUs"] // phase["count"], phase["maxUs"]))
+            cells.append(str(phase["stackFree"]))
+        cells += [str(heap_min), str(block_min)]
+        print("|" + "|".join(cells) + "|")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: bench_compare.py <log> [<log> ...]")
+
+    main(sys.argv[1:])
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+#
+# Read the binary tag events emitted over USB serial by firmware built with
+# -DSERIAL_EVENTS, printing one JSON object per event
+#
+#   pip install pyserial
+#   python tools/serial_events.py /dev/ttyUSB0 [baud]
+#
+# Frames are COBS encoded and delimited by 0x00. Decoded frames are
+#   type (1), count (4), uptime ms (4), card type (1), uid length (1), uid, crc16 (2)
+# little-endian, with a CRC-16/CCITT-FALSE over everything before the CRC.
+# Anything that fails to decode (e.g. debug text) is skipped.
+#
+
+import json
+import struct
+import sys
+
+EVENT_TYPES = {0x01: "arrived", 0x02: "removed"}
+CARD_TYPES = ["unknown", "classic", "type2", "iso14443-4", "iso15693"]
+
+
+def cobs_decode(data):
+    output = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + 1:
+            return None
+        output += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            output.append(0)
+    return bytes(output)
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def parse_frame(encoded):
+    frame = cobs_decode(encoded)
+    if frame is None or len(frame) < 13:
+        return None
+
+    if crc16(frame[:-2]) != struct.unpack("<H", frame[-2:])[0]:
+        return None
+
+    event_type, count, uptime_ms, card_type, uid_length = struct.unpack("<BIIBB", frame[:11])
+    if len(frame) != 11 + uid_length + 2:
+        return None
+
+    return {
+        "event": EVENT_TYPES.get(event_type, event_type),
+        "count": count,
+        "uptimeMs": uptime_ms,
+        "cardType": CARD_TYPES[card_type] if card_type < len(CARD_TYPES) else card_type,
+        "uid": frame[11:11 + uid_length].hex().upper(),
+    }
+
+
+def read_events(stream):
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(1)
+        if not chunk:
+            continue
+
+        if chunk[0] != 0:
+            buffer += chunk
+            continue
+
+        if buffer:
+            event = parse_frame(bytes(buffer))
+            if event:
+                yield event
+        buffer.clear()
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: serial_events.py <port> [baud]")
+
+    import serial
+
+    baud = int(sys.argv[2]) if len(sys.argv) > 2 else 921600
+    with serial.Serial(sys.argv[1], baud) as port:
+        for event in read_events(port):
+            print(json.dumps(event), flush=True)
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+#
+# Convert the span buffer exported by the firmware (GET /spans) into
+# Chrome trace JSON, viewable in chrome://tracing or ui.perfetto.dev
+#
+#   python tools/spans2trace.py http://<device-ip>/spans > trace.json
+#   python tools/spans2trace.py spans.json > trace.json
+#
+
+import json
+import sys
+import urllib.request
+
+
+def load(source):
+    if source.startswith("http://") or source.startswith("https://"):
+        with urllib.request.urlopen(source) as response:
+            return json.load(response)
+
+    with open(source) as f:
+        return json.load(f)
+
+
+def convert(export):
+    names = export["names"]
+    cycles_per_us = export["cpuMHz"]
+
+    events = []
+    last_cycles = None
+    last_ms = None
+    elapsed = 0
+
+    for span_id, begin, cycles, ms in export["spans"]:
+        # the cycle counter is 32-bit and wraps every ~53s at 80MHz, and idle
+        # work isn't recorded so entries can be further apart than that, use
+        # the millisecond clock to work out how many times it wrapped
+        if last_cycles is not None:
+            delta = (cycles - last_cycles) & 0xFFFFFFFF
+            delta_ms = (ms - last_ms) & 0xFFFFFFFF
+            wraps = round((delta_ms * cycles_per_us * 1000 - delta) / 2 ** 32)
+            elapsed += delta + max(wraps, 0) * 2 ** 32
+        last_cycles = cycles
+        last_ms = ms
+
+        events.append({
+            "name": names[span_id] if span_id < len(names) else str(span_id),
+            "ph": "B" if begin else "E",
+            "ts": elapsed / cycles_per_us,
+            "pid": 0,
+            "tid": 0,
+        })
+
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit("usage: spans2trace.py <url|file>")
+
+    json.dump(convert(load(sys.argv[1])), sys.stdout, indent=1)